@@ -0,0 +1,220 @@
+/**
+ * @file bench.cc
+ * @brief Benchmarks of the cafana variables, cuts, and tree-filling path.
+ * @details This executable generates synthetic spills (see synthetic.h) with
+ * a configurable multiplicity and microbenchmarks the variables (vars::),
+ * particle variables (pvars::), cuts (cuts:: and cuts::muon2024::), and
+ * utilities (utilities::) used by the analysis macros, followed by an
+ * end-to-end benchmark of the SPINEVAR tree-filling path. The results are
+ * printed and written as JSON (see harness.h).
+ * Usage: bench_cafana [--spills N] [--interactions N] [--particles N]
+ * [--seed N] [--min-time S] [--output PATH]
+ * @note The interaction variables are evaluated with the Summary cache
+ * active for each spill (as in the Trees of the Analysis class), so the first
+ * use of the Summary of each interaction is included in the timing.
+ * @author mueller@fnal.gov
+ */
+#include <vector>
+#include <string>
+#include <map>
+#include <functional>
+
+#include "include/variables.h"
+#include "include/cuts.h"
+#include "include/muon2024/cuts_muon2024.h"
+#include "include/muon2024/variables_muon2024.h"
+#include "include/preprocessor.h"
+#include "include/utilities.h"
+
+#include "bench/synthetic.h"
+#include "bench/harness.h"
+
+/**
+ * @brief Benchmark a function of a single interaction over all reco
+ * interactions of the spills.
+ * @param harness The benchmark harness.
+ * @param name The name of the benchmark.
+ * @param spills The synthetic spills.
+ * @param f The function of a single interaction.
+ * @return void
+ */
+template<class F>
+    void bench_interactions(bench::Harness & harness, const std::string & name, const std::vector<bench::Spill> & spills, F f)
+    {
+        size_t n(0);
+        for(const bench::Spill & s : spills)
+            n += s.dlp.size();
+        harness.Run(name, n, [&spills, &f]()
+        {
+            double sum(0);
+            uint64_t index(0);
+            utilities::reset_spills();
+            for(const bench::Spill & s : spills)
+            {
+                utilities::enter_spill(++index);
+                for(const bench::Interaction & i : s.dlp)
+                    sum += f(i);
+            }
+            bench::keep(sum);
+        });
+    }
+
+/**
+ * @brief Benchmark a function of a single particle over all particles of the
+ * reco interactions of the spills.
+ * @param harness The benchmark harness.
+ * @param name The name of the benchmark.
+ * @param spills The synthetic spills.
+ * @param f The function of a single particle.
+ * @return void
+ */
+template<class F>
+    void bench_particles(bench::Harness & harness, const std::string & name, const std::vector<bench::Spill> & spills, F f)
+    {
+        size_t n(0);
+        for(const bench::Spill & s : spills)
+            for(const bench::Interaction & i : s.dlp)
+                n += i.particles.size();
+        harness.Run(name, n, [&spills, &f]()
+        {
+            double sum(0);
+            for(const bench::Spill & s : spills)
+                for(const bench::Interaction & i : s.dlp)
+                    for(const bench::Particle & p : i.particles)
+                        sum += f(p);
+            bench::keep(sum);
+        });
+    }
+
+/**
+ * @brief Preprocessor wrappers declaring the benchmark of a (templated)
+ * interaction or particle function under its own name.
+ */
+#define BENCH_INTERACTION(F) bench_interactions(harness, #F, spills, [](const bench::Interaction & i) { return double(F(i)); })
+#define BENCH_PARTICLE(F) bench_particles(harness, #F, spills, [](const bench::Particle & p) { return double(F(p)); })
+
+int main(int argc, char * argv[])
+{
+    std::map<std::string, std::string> args(bench::parse_arguments(argc, argv, {
+        {"spills", "1000"}, {"interactions", "8"}, {"particles", "6"}, {"seed", "12345"},
+        {"min-time", "0.1"}, {"output", "bench_cafana.json"}}));
+    bench::SpillConfig config;
+    config.nspills = std::stoul(args["spills"]);
+    config.ninteractions = std::stoul(args["interactions"]);
+    config.nparticles = std::stoul(args["particles"]);
+    config.seed = std::stoull(args["seed"]);
+    std::vector<bench::Spill> spills(bench::make_spills(config));
+    bench::Harness harness(std::stod(args["min-time"]));
+
+    /**
+     * @brief Benchmark the particle variables and cuts.
+     */
+    BENCH_PARTICLE(pvars::energy);
+    BENCH_PARTICLE(pvars::ke_init);
+    BENCH_PARTICLE(pvars::transverse_momentum);
+    BENCH_PARTICLE(pvars::polar_angle);
+    BENCH_PARTICLE(pvars::azimuthal_angle);
+    BENCH_PARTICLE(pcuts::final_state_signal);
+
+    /**
+     * @brief Benchmark the utilities. The uncached Summary is rebuilt on
+     * each call, which is the cost of the first use of the Summary of each
+     * interaction in a spill.
+     */
+    bench_interactions(harness, "utilities::fill_summary", spills, [](const bench::Interaction & i)
+    {
+        thread_local utilities::Summary s;
+        utilities::fill_summary(i, s);
+        return double(s.counts[2]);
+    });
+    bench_interactions(harness, "utilities::leading_particle_index", spills, [](const bench::Interaction & i) { return double(utilities::leading_particle_index(i, 2)); });
+    bench_interactions(harness, "utilities::count_primaries", spills, [](const bench::Interaction & i) { return double(utilities::count_primaries(i)[4]); });
+
+    /**
+     * @brief Benchmark the interaction variables.
+     */
+    BENCH_INTERACTION(vars::visible_energy);
+    BENCH_INTERACTION(vars::flash_time);
+    BENCH_INTERACTION(vars::vertex_x);
+    BENCH_INTERACTION(vars::leading_muon_end_x);
+    BENCH_INTERACTION(vars::leading_muon_softmax);
+    BENCH_INTERACTION(vars::leading_muon_ke);
+    BENCH_INTERACTION(vars::leading_proton_ke);
+    BENCH_INTERACTION(vars::leading_muon_pt);
+    BENCH_INTERACTION(vars::muon_polar_angle);
+    BENCH_INTERACTION(vars::muon_azimuthal_angle);
+    BENCH_INTERACTION(vars::interaction_pt);
+    BENCH_INTERACTION(vars::phiT);
+    BENCH_INTERACTION(vars::alphaT);
+    BENCH_INTERACTION(vars::muon2024::opening_angle);
+
+    /**
+     * @brief Benchmark the interaction cuts.
+     */
+    BENCH_INTERACTION(cuts::valid_flashmatch);
+    BENCH_INTERACTION(cuts::fiducial_cut);
+    BENCH_INTERACTION(cuts::containment_cut);
+    BENCH_INTERACTION(cuts::flash_cut_bnb);
+    BENCH_INTERACTION(cuts::fiducial_containment_flash_cut_bnb);
+    BENCH_INTERACTION(cuts::muon2024::topological_1mu1p_cut);
+    BENCH_INTERACTION(cuts::muon2024::topological_1muNp_cut);
+    BENCH_INTERACTION(cuts::muon2024::topological_1muX_cut);
+    BENCH_INTERACTION(cuts::muon2024::all_1mu1p_cut);
+    BENCH_INTERACTION(cuts::muon2024::all_1muNp_cut);
+    BENCH_INTERACTION(cuts::muon2024::all_1muX_cut);
+
+    /**
+     * @brief Benchmark the SPINEVAR tree-filling path.
+     * @details A Tree of the muon2024 selection with one column per variable
+     * is filled for every spill: each column is evaluated (looping over the
+     * interactions of the spill, applying the cut, and broadcasting the
+     * variable) and its entries appended to the column, as the CAFAna Tree
+     * does. Each spill is entered with the Summary cache first, as done by
+     * the first column of the Trees of the Analysis class. The items are the
+     * spills.
+     */
+    typedef std::function<std::vector<double>(const bench::Spill *)> column_t;
+    #define CUT cuts::muon2024::all_1mu1p_cut
+    std::vector<column_t> columns = {
+        SPINEVAR_RR(vars::visible_energy, CUT, cuts::no_cut),
+        SPINEVAR_RR(vars::flash_time, CUT, cuts::no_cut),
+        SPINEVAR_RR(vars::vertex_x, CUT, cuts::no_cut),
+        SPINEVAR_RR(vars::vertex_y, CUT, cuts::no_cut),
+        SPINEVAR_RR(vars::vertex_z, CUT, cuts::no_cut),
+        SPINEVAR_RR(vars::leading_muon_ke, CUT, cuts::no_cut),
+        SPINEVAR_RR(vars::leading_proton_ke, CUT, cuts::no_cut),
+        SPINEVAR_RR(vars::leading_muon_pt, CUT, cuts::no_cut),
+        SPINEVAR_RR(vars::leading_proton_pt, CUT, cuts::no_cut),
+        SPINEVAR_RR(vars::muon_polar_angle, CUT, cuts::no_cut),
+        SPINEVAR_RR(vars::muon_azimuthal_angle, CUT, cuts::no_cut),
+        SPINEVAR_RR(vars::interaction_pt, CUT, cuts::no_cut),
+        SPINEVAR_RR(vars::phiT, CUT, cuts::no_cut),
+        SPINEVAR_RR(vars::alphaT, CUT, cuts::no_cut),
+        SPINEVAR_RT(vars::leading_muon_ke, CUT, cuts::no_cut),
+        SPINEVAR_RT(vars::vertex_x, CUT, cuts::no_cut)
+    };
+    #undef CUT
+    std::vector<std::vector<double>> filled(columns.size());
+    harness.Run("spinevar_tree_fill/" + std::to_string(columns.size()) + "_columns", spills.size(), [&]()
+    {
+        for(std::vector<double> & f : filled)
+            f.clear();
+        uint64_t index(0);
+        utilities::reset_spills();
+        for(const bench::Spill & s : spills)
+        {
+            utilities::enter_spill(++index);
+            for(size_t c(0); c < columns.size(); ++c)
+            {
+                std::vector<double> v(columns[c](&s));
+                filled[c].insert(filled[c].end(), v.begin(), v.end());
+            }
+        }
+        bench::keep(filled[0].size());
+    });
+
+    harness.WriteJSON(args["output"], "cafana", {
+        {"spills", double(config.nspills)}, {"interactions", double(config.ninteractions)},
+        {"particles", double(config.nparticles)}, {"seed", double(config.seed)}});
+    return 0;
+}
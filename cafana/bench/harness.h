@@ -0,0 +1,162 @@
+/**
+ * @file harness.h
+ * @brief Header file for the minimal benchmark harness shared by the cafana
+ * and systematics benchmarks.
+ * @details Each benchmark is a function run repeatedly (doubling the number
+ * of iterations) until the total time exceeds a minimum. The fastest of a few
+ * such repetitions is reported, which is the most stable estimate on a shared
+ * machine. The results are written as JSON with one object per benchmark and
+ * stable names, so that two reports can be compared benchmark-by-benchmark to
+ * find regressions.
+ * @author mueller@fnal.gov
+ */
+#ifndef HARNESS_H
+#define HARNESS_H
+#include <vector>
+#include <string>
+#include <map>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+namespace bench
+{
+    /**
+     * @brief Prevent the compiler from optimizing away the computation of a
+     * value.
+     * @tparam T The type of the value.
+     * @param value The value to keep.
+     * @return void
+     */
+    template<class T>
+        inline void keep(const T & value)
+        {
+            asm volatile("" : : "r,m"(value) : "memory");
+        }
+
+    /**
+     * @struct result_t
+     * @brief Struct storing the result of a single benchmark.
+     * @details The items are the unit of work of the benchmark (e.g. the
+     * interactions visited by a variable), so ns_per_item is comparable
+     * across multiplicities.
+     */
+    struct result_t
+    {
+        std::string name;
+        uint64_t iterations;
+        double ns_per_iteration;
+        double items_per_iteration;
+        double ns_per_item;
+    };
+
+    /**
+     * @class Harness
+     * @brief Class running the benchmarks and collecting their results.
+     */
+    class Harness
+    {
+        public:
+            /**
+             * @brief Constructor for the Harness class.
+             * @param min_time The minimum time (s) of each repetition.
+             * @param repetitions The number of repetitions of each benchmark.
+             */
+            Harness(double min_time, size_t repetitions = 3) : min_time(min_time), repetitions(std::max<size_t>(repetitions, 1)) {}
+
+            /**
+             * @brief Run a benchmark.
+             * @tparam F The type of the benchmarked function.
+             * @param name The name of the benchmark.
+             * @param items The number of items processed by each call.
+             * @param f The benchmarked function (called with no arguments).
+             * @return void
+             */
+            template<class F>
+                void Run(const std::string & name, double items, F && f)
+                {
+                    f();
+                    double best(0);
+                    uint64_t best_n(0);
+                    for(size_t r(0); r < repetitions; ++r)
+                    {
+                        for(uint64_t n(1); ; n *= 2)
+                        {
+                            auto start(std::chrono::steady_clock::now());
+                            for(uint64_t i(0); i < n; ++i)
+                                f();
+                            double elapsed(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+                            if(elapsed < min_time)
+                                continue;
+                            double per(1e9 * elapsed / n);
+                            if(best_n == 0 || per < best)
+                            {
+                                best = per;
+                                best_n = n;
+                            }
+                            break;
+                        }
+                    }
+                    results.push_back({name, best_n, best, items, items > 0 ? best / items : best});
+                    std::printf("%-50s %12.1f ns/iter %10.2f ns/item\n", name.c_str(), best, results.back().ns_per_item);
+                }
+
+            /**
+             * @brief Write the results as JSON.
+             * @param path The path of the JSON file.
+             * @param suite The name of the benchmark suite.
+             * @param context The configuration of the benchmarks (e.g. the
+             * multiplicity of the inputs).
+             * @return void
+             */
+            void WriteJSON(const std::string & path, const std::string & suite, const std::map<std::string, double> & context) const
+            {
+                std::ofstream file(path);
+                file << "{\n  \"suite\": \"" << suite << "\",\n  \"context\": {";
+                size_t k(0);
+                for(const auto & [key, value] : context)
+                    file << (k++ ? ", " : "") << "\"" << key << "\": " << value;
+                file << "},\n  \"benchmarks\": [\n";
+                for(size_t i(0); i < results.size(); ++i)
+                {
+                    const result_t & r(results[i]);
+                    file << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+                         << ", \"ns_per_iteration\": " << r.ns_per_iteration << ", \"items_per_iteration\": " << r.items_per_iteration
+                         << ", \"ns_per_item\": " << r.ns_per_item << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+                }
+                file << "  ]\n}\n";
+                std::cout << "Wrote " << results.size() << " benchmark results to " << path << "." << std::endl;
+            }
+
+        private:
+            double min_time;
+            size_t repetitions;
+            std::vector<result_t> results;
+    };
+
+    /**
+     * @brief Parse the "--key value" arguments of a benchmark executable.
+     * @param argc The number of arguments.
+     * @param argv The arguments.
+     * @param defaults The known keys and their default values.
+     * @return The values of all known keys.
+     */
+    std::map<std::string, std::string> parse_arguments(int argc, char * argv[], std::map<std::string, std::string> defaults)
+    {
+        for(int i(1); i + 1 < argc; i += 2)
+        {
+            std::string key(argv[i]);
+            if(key.rfind("--", 0) != 0 || defaults.find(key.substr(2)) == defaults.end())
+            {
+                std::cerr << "Warning: Ignoring unknown argument " << key << "." << std::endl;
+                continue;
+            }
+            defaults[key.substr(2)] = argv[i+1];
+        }
+        return defaults;
+    }
+}
+#endif // HARNESS_H
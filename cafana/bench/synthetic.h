@@ -0,0 +1,224 @@
+/**
+ * @file synthetic.h
+ * @brief Header file for the synthetic spills used by the benchmarks.
+ * @details The variables and cuts of cafana are templated on the type of the
+ * interaction (and the SPINEVAR macros on the type of the spill), so they can
+ * be evaluated on plain structs with the same fields as the SRSpillProxy
+ * hierarchy. The synthetic spills are generated from a fixed seed with a
+ * configurable multiplicity (spills, interactions per spill, and particles
+ * per interaction), so the benchmarks are reproducible and need no input
+ * files. The synthetic true interactions share the type of the reco
+ * interactions, so the templated code always takes its "reco" branches.
+ * @author mueller@fnal.gov
+ */
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+#include <vector>
+#include <array>
+#include <random>
+#include <cmath>
+#include <cstdint>
+
+/**
+ * @namespace bench
+ * @brief Namespace for the benchmarks of the cafana variables, cuts, and
+ * tree-building paths.
+ */
+namespace bench
+{
+    /**
+     * @struct Particle
+     * @brief Synthetic particle with the fields of SRParticleDLPProxy (and
+     * SRParticleTruthDLPProxy) used by the variables and cuts.
+     */
+    struct Particle
+    {
+        int pid;
+        bool is_primary;
+        bool is_contained;
+        double csda_ke;
+        double mcs_ke;
+        double calo_ke;
+        double energy_init;
+        double energy_deposit;
+        std::array<double, 3> momentum;
+        std::array<double, 3> truth_momentum;
+        std::array<double, 3> start_dir;
+        std::array<double, 3> truth_start_dir;
+        std::array<double, 3> end_point;
+        std::array<double, 5> pid_scores;
+    };
+
+    /**
+     * @struct Interaction
+     * @brief Synthetic interaction with the fields of SRInteractionDLPProxy
+     * (and SRInteractionTruthDLPProxy) used by the variables and cuts.
+     */
+    struct Interaction
+    {
+        std::vector<Particle> particles;
+        std::vector<uint64_t> match;
+        std::array<double, 3> vertex;
+        std::array<double, 3> truth_vertex;
+        bool is_fiducial;
+        bool is_contained;
+        bool is_neutrino;
+        int64_t nu_id;
+        double flash_time;
+        double flash_total_pe;
+        double flash_hypothesis;
+        int fmatched;
+        double nu_energy_init;
+        double nu_distance_travel;
+        int nu_pdg_code;
+        int nu_current_type;
+        int nu_interaction_mode;
+    };
+
+    /**
+     * @struct Header
+     * @brief Synthetic header of a spill.
+     */
+    struct Header
+    {
+        uint32_t run;
+        uint32_t subrun;
+        uint32_t evt;
+    };
+
+    /**
+     * @struct Spill
+     * @brief Synthetic spill with the fields of SRSpillProxy used by the
+     * SPINEVAR macros.
+     */
+    struct Spill
+    {
+        Header hdr;
+        std::vector<Interaction> dlp;
+        std::vector<Interaction> dlp_true;
+        size_t ndlp_true;
+    };
+
+    /**
+     * @struct SpillConfig
+     * @brief Struct storing the multiplicity of the synthetic spills.
+     */
+    struct SpillConfig
+    {
+        size_t nspills = 1000; ///< The number of spills.
+        size_t ninteractions = 8; ///< The number of interactions per spill.
+        size_t nparticles = 6; ///< The number of particles per interaction.
+        uint64_t seed = 12345; ///< The seed of the generator.
+    };
+
+    /**
+     * @brief Generate a random unit vector.
+     * @param rng The random number generator.
+     * @return The unit vector.
+     */
+    std::array<double, 3> random_direction(std::mt19937_64 & rng)
+    {
+        std::uniform_real_distribution<double> cos_theta(-1.0, 1.0), phi(0, 2 * M_PI);
+        double c(cos_theta(rng)), s(std::sqrt(1 - c * c)), p(phi(rng));
+        return {s * std::cos(p), s * std::sin(p), c};
+    }
+
+    /**
+     * @brief Generate a synthetic particle.
+     * @details The particle types, energies, and flags are drawn so that a
+     * realistic fraction of the particles pass the final state signal
+     * requirements.
+     * @param rng The random number generator.
+     * @return The particle.
+     */
+    Particle make_particle(std::mt19937_64 & rng)
+    {
+        std::uniform_int_distribution<int> pid(0, 4);
+        std::uniform_real_distribution<double> unit(0, 1), ke(0, 1000);
+        Particle p;
+        p.pid = pid(rng);
+        p.is_primary = unit(rng) < 0.7;
+        p.is_contained = unit(rng) < 0.8;
+        p.csda_ke = ke(rng);
+        p.mcs_ke = ke(rng);
+        p.calo_ke = ke(rng);
+        p.energy_init = p.csda_ke + 105.66;
+        p.energy_deposit = 0.9 * p.csda_ke;
+        p.start_dir = random_direction(rng);
+        p.truth_start_dir = p.start_dir;
+        for(size_t k(0); k < 3; ++k)
+        {
+            p.momentum[k] = p.csda_ke * p.start_dir[k];
+            p.truth_momentum[k] = p.momentum[k];
+            p.end_point[k] = 200 * (unit(rng) - 0.5);
+        }
+        double norm(0);
+        for(double & s : p.pid_scores)
+            norm += (s = unit(rng));
+        for(double & s : p.pid_scores)
+            s /= norm;
+        return p;
+    }
+
+    /**
+     * @brief Generate a synthetic interaction.
+     * @param rng The random number generator.
+     * @param nparticles The number of particles of the interaction.
+     * @param nu_id The neutrino id of the interaction.
+     * @return The interaction.
+     */
+    Interaction make_interaction(std::mt19937_64 & rng, size_t nparticles, int64_t nu_id)
+    {
+        std::uniform_real_distribution<double> unit(0, 1), position(-300, 300), time(-2, 10);
+        Interaction i;
+        for(size_t p(0); p < nparticles; ++p)
+            i.particles.push_back(make_particle(rng));
+        for(size_t k(0); k < 3; ++k)
+            i.vertex[k] = position(rng);
+        i.truth_vertex = i.vertex;
+        i.is_fiducial = unit(rng) < 0.8;
+        i.is_contained = unit(rng) < 0.8;
+        i.is_neutrino = nu_id >= 0;
+        i.nu_id = nu_id;
+        i.flash_time = time(rng);
+        i.flash_total_pe = 1000 * unit(rng);
+        i.flash_hypothesis = 1000 * unit(rng);
+        i.fmatched = unit(rng) < 0.9;
+        i.nu_energy_init = 3 * unit(rng);
+        i.nu_distance_travel = 600 * unit(rng);
+        i.nu_pdg_code = 14;
+        i.nu_current_type = unit(rng) < 0.7 ? 0 : 1;
+        i.nu_interaction_mode = 0;
+        return i;
+    }
+
+    /**
+     * @brief Generate the synthetic spills.
+     * @details Each spill has the configured number of reco and true
+     * interactions, and each reco interaction is matched to the true
+     * interaction of the same index. The first interaction of each spill is
+     * a neutrino, and all others are cosmics.
+     * @param config The multiplicity of the spills.
+     * @return The spills.
+     */
+    std::vector<Spill> make_spills(const SpillConfig & config)
+    {
+        std::mt19937_64 rng(config.seed);
+        std::vector<Spill> spills(config.nspills);
+        for(size_t s(0); s < config.nspills; ++s)
+        {
+            Spill & spill(spills[s]);
+            spill.hdr = Header{1, uint32_t(s / 100), uint32_t(s)};
+            for(size_t i(0); i < config.ninteractions; ++i)
+            {
+                spill.dlp.push_back(make_interaction(rng, config.nparticles, i == 0 ? 0 : -1));
+                spill.dlp.back().match.push_back(i);
+                spill.dlp_true.push_back(make_interaction(rng, config.nparticles, i == 0 ? 0 : -1));
+                spill.dlp_true.back().match.push_back(i);
+            }
+            spill.ndlp_true = spill.dlp_true.size();
+        }
+        return spills;
+    }
+}
+#endif // SYNTHETIC_H
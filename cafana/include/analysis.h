@@ -17,6 +17,19 @@
 #define ANALYSIS_H
 #include <vector>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <map>
+#include <set>
+#include <memory>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
 
 #include "sbnana/CAFAna/Core/SpectrumLoader.h"
 #include "sbnana/CAFAna/Core/Tree.h"
@@ -25,6 +38,22 @@
 
 #include "TDirectory.h"
 #include "TFile.h"
+#include "TROOT.h"
+#include "TNamed.h"
+#include "TSystem.h"
+#include "TMemFile.h"
+#include "TH1.h"
+
+#include "include/selection.h"
+#include "include/registry.h"
+#include "include/columnar.h"
+#include "include/cache.h"
+#include "include/friend.h"
+#include "include/profile.h"
+#include "include/shard.h"
+#include "include/skim.h"
+#include "include/stream.h"
+#include "include/prefetch.h"
 
 /**
  * @namespace ana
@@ -43,13 +72,23 @@ namespace ana
      * analysis, including the name of the sample, the SpectrumLoader object
      * representing the sample, and a boolean indicating whether the sample is
      * a simulation sample. The simulation flag is used to determine if truth
-     * information is available for the sample.
+     * information is available for the sample. The source (file path or
+     * wildcard) of the sample is only known if the loader was created by the
+     * Analysis class, and is required for the sample to be reused by an
+     * incremental run or to be sharded. The SpectrumLoader of such a sample
+     * is only created by @ref Analysis::Go(), and in shard mode the input
+     * files of the shard are stored with the sample. The skim flag marks a
+     * sample whose input files are skims (see @ref skim_file()), for which
+     * the exposure of the full input files is reported.
      */
     struct Sample
     {
         std::string name;
         ana::SpectrumLoader * loader;
         bool is_sim;
+        std::string source;
+        std::vector<std::string> files;
+        bool skim;
     };
 
     /**
@@ -59,17 +98,38 @@ namespace ana
      * @details This struct is used to store information about a set of variables
      * that comprise a Tree in the analysis. The Tree is used to store the results
      * of the analysis in a TTree in the output ROOT file. The struct contains the
-     * name of the Tree, the names of the variables, the SpillMultiVars that
-     * implement the variables, and a boolean indicating whether the Tree
-     * represents a simulation sample. The simulation flag is used to determine
-     * if truth information is present in the Tree.
+     * name of the Tree, the names of the variables, a function that books the
+     * SpillMultiVars that implement the variables, and a boolean indicating
+     * whether the Tree represents a simulation sample. The simulation flag is
+     * used to determine if truth information is present in the Tree. The
+     * SpillMultiVars are booked once per sample so that any state they carry
+     * (e.g. a cached selection) is never shared between samples. The version
+     * is a user-supplied tag that is part of the manifest of each sample, and
+     * should be changed whenever the definition (but not the names) of the
+     * variables changes. If the sample is profiled, the booking function
+     * receives the profile of the sample so that it may profile the cuts of
+     * the Tree (and nullptr otherwise). The write options are only used if
+     * the Tree is streamed (see @ref Analysis::SetStreaming()). The storage
+     * types of the columns (see @ref Analysis::SetColumnType()) default to
+     * double. The preselection flag determines whether the spill-level
+     * preselection (see @ref Analysis::SetSpillCut()) gates the Tree. It is
+     * cleared for the truth-driven Trees, whose entries do not depend on
+     * the reco interactions a preselection typically tests. The column
+     * profiling flag is set for the Trees whose booking function profiles
+     * the columns itself (the fused Trees), which are then not wrapped with
+     * a per-column counter.
      */
     struct TreeSet
     {
         std::string name;
         std::vector<std::string> names;
-        std::vector<ana::SpillMultiVar> vars;
+        std::function<std::vector<ana::SpillMultiVar>(SampleProfile *)> book;
         bool is_sim;
+        std::string version;
+        WriteOptions options = {};
+        column_types_t types = {};
+        bool preselect = true;
+        bool profiles_columns = false;
     };
 
     /**
@@ -91,12 +151,54 @@ namespace ana
         public:
             Analysis(std::string name);
             void AddLoader(std::string name, ana::SpectrumLoader * loader, bool is_sim);
+            void AddLoader(std::string name, std::string source, bool is_sim);
+            void AddSkim(std::string name, std::string source, bool is_sim);
             void AddTree(std::string name, std::map<std::string, ana::SpillMultiVar> & vars, bool is_sim);
+            void AddTree(std::string name, RecoCut cut, TrueCut truth_cut, const std::vector<SelectedVar> & vars, bool is_sim);
+            void AddTruthTree(std::string name, TrueCut truth_cut, const std::vector<SelectedVar> & vars, bool is_sim);
+            template<class Cut, class TruthCut, class... Columns>
+                void AddTree(std::string name, bool is_sim);
+            template<class TruthCut, class... Columns>
+                void AddTruthTree(std::string name, bool is_sim);
+            void SetParallel(size_t nworkers);
+            void SetColumnarOutput(bool compact = false);
+            void SetVersion(std::string tree, std::string version);
+            void SetIncremental(bool incremental);
+            void SetFriendMode(bool friends);
+            void SetSpillCut(SpillPrecut cut);
+            void SetPreselection(std::string tree, bool preselect);
+            void SetProfiling(bool profiling);
+            void SetShard(size_t index, size_t count);
+            void SetShard(const std::string & spec);
+            void SetSkimMode(bool skimming);
+            void SetStreaming(bool streaming);
+            void SetWriteOptions(std::string tree, int basket_size, int compression, long long autoflush);
+            void SetColumnType(std::string tree, std::string column, ColumnType type);
+            void SetPrefetch(size_t depth, long long cache_size = 256LL << 20);
             void Go();
         private:
+            void AddSortedTree(std::string name, const std::vector<std::string> & names, std::function<std::vector<ana::SpillMultiVar>(SampleProfile *)> book, bool is_sim, bool preselect);
+            void Skim();
+            void RunSample(const Sample & s, TDirectory * subdir, TDirectory * profdir, const std::string & manifest, std::mutex & output_mutex);
+            std::string Manifest(const Sample & s) const;
+            std::string OutputName() const;
             std::string name;
             std::vector<Sample> samples;
+            std::vector<std::unique_ptr<ana::SpectrumLoader>> loaders;
             std::vector<TreeSet> trees;
+            size_t nworkers;
+            bool columnar;
+            bool compact;
+            bool incremental;
+            bool friends;
+            SpillPrecut spill_cut;
+            bool profiling;
+            size_t shard;
+            size_t nshards;
+            bool skimming;
+            bool streaming;
+            size_t prefetch_depth;
+            long long prefetch_size;
     };
 
     /**
@@ -110,6 +212,18 @@ namespace ana
     Analysis::Analysis(std::string name)
     {
         this->name = name;
+        this->nworkers = 1;
+        this->columnar = false;
+        this->compact = false;
+        this->incremental = false;
+        this->friends = false;
+        this->profiling = false;
+        this->shard = 0;
+        this->nshards = 1;
+        this->skimming = false;
+        this->streaming = false;
+        this->prefetch_depth = 0;
+        this->prefetch_size = 0;
     }
 
     /**
@@ -128,7 +242,49 @@ namespace ana
      */
     void Analysis::AddLoader(std::string name, ana::SpectrumLoader * loader, bool is_sim)
     {
-        samples.push_back({name, loader, is_sim});
+        samples.push_back({name, loader, is_sim, "", {}, false});
+    }
+
+    /**
+     * @brief Add a sample to the Analysis class from its input files.
+     * @details The Analysis class creates (and owns) the SpectrumLoader of
+     * the sample when it is run. Unlike samples added with an existing
+     * SpectrumLoader, the input files of the sample are known, so the sample
+     * may be reused by an incremental run (see @ref SetIncremental()) or
+     * sharded (see @ref SetShard()).
+     * @param name The name of the sample.
+     * @param source The file path or wildcard of the input files, as passed
+     * to the SpectrumLoader.
+     * @param is_sim A boolean indicating whether the sample is a simulation
+     * sample, which is principally used to determine if truth information is
+     * available.
+     * @return void
+     */
+    void Analysis::AddLoader(std::string name, std::string source, bool is_sim)
+    {
+        samples.push_back({name, nullptr, is_sim, source, {}, false});
+    }
+
+    /**
+     * @brief Add a sample to the Analysis class from its skimmed input files.
+     * @details The sample is run like a sample added with its input files
+     * (see @ref AddLoader()), but the skimmed files only contain the spills
+     * passing the preselection of the skim (see @ref SetSkimMode()). The POT
+     * and Livetime written for the sample are therefore replaced by the
+     * exposure of the full input files, which is stored in the skimmed
+     * files. The selections of the Trees must be tighter than the
+     * preselection of the skim.
+     * @param name The name of the sample.
+     * @param source The file path or wildcard of the skimmed input files
+     * (e.g. all ROOT files in "<name>.skim/<sample>/").
+     * @param is_sim A boolean indicating whether the sample is a simulation
+     * sample, which is principally used to determine if truth information is
+     * available.
+     * @return void
+     */
+    void Analysis::AddSkim(std::string name, std::string source, bool is_sim)
+    {
+        samples.push_back({name, nullptr, is_sim, source, {}, true});
     }
 
     /**
@@ -155,7 +311,778 @@ namespace ana
             n.push_back(name);
             v.push_back(var);
         }
-        trees.push_back({name, n, v, is_sim});
+        trees.push_back({name, n, [v](SampleProfile *) { return v; }, is_sim, ""});
+    }
+
+    /**
+     * @brief Add a Tree with its columns in alphabetical order.
+     * @details The branches of a Tree added with a map of variables are in
+     * the (alphabetical) order of the map, which the readers of the output
+     * rely on (e.g. the systematics framework reads the columns in order,
+     * followed by the Run, Subrun, and Evt branches). The selected and fused
+     * Trees are declared with their columns in an arbitrary order, so their
+     * columns are sorted by name in the same way, and the SpillMultiVars
+     * returned by the booking function are permuted to match.
+     * @param name The name of the Tree.
+     * @param names The names of the columns, in the order of booking.
+     * @param book The function booking the columns (see @ref TreeSet).
+     * @param is_sim A boolean indicating whether the Tree represents a
+     * simulation sample.
+     * @param preselect Whether the Tree is gated by the spill-level
+     * preselection (see @ref TreeSet).
+     * @return void
+     */
+    void Analysis::AddSortedTree(std::string name, const std::vector<std::string> & names, std::function<std::vector<ana::SpillMultiVar>(SampleProfile *)> book, bool is_sim, bool preselect)
+    {
+        std::vector<size_t> order(names.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&names](size_t a, size_t b) { return names[a] < names[b]; });
+        std::vector<std::string> n;
+        for(size_t c : order)
+            n.push_back(names[c]);
+        trees.push_back({name, n, [book, order](SampleProfile * profile)
+        {
+            std::vector<ana::SpillMultiVar> vars(book(profile));
+            std::vector<ana::SpillMultiVar> v;
+            for(size_t c : order)
+                v.push_back(vars[c]);
+            return v;
+        }, is_sim, ""});
+        trees.back().preselect = preselect;
+    }
+
+    /**
+     * @brief Add a selected Tree to the Analysis class.
+     * @details This function adds a new Tree whose columns are all evaluated
+     * over the reco interactions passing a common selection. The selection
+     * (the reco cut and, for simulation, the truth category cut on the
+     * matched true interaction) is evaluated once per spill and shared by all
+     * columns of the Tree. Columns acting on the true interaction are filled
+     * with utilities::kUnmatched for candidates without a match. This is
+     * equivalent to, but much cheaper than, building each column with
+     * SPINEVAR_RR/SPINEVAR_RT using the same cut. If profiled, the reco and truth cuts are profiled
+     * separately from the columns.
+     * @param name The name of the Tree.
+     * @param cut The cut applied to each reco interaction.
+     * @param truth_cut The cut applied to the true interaction matched to by
+     * each reco interaction (simulation only).
+     * @param vars The columns of the Tree (written in alphabetical order).
+     * @param is_sim A boolean indicating whether the Tree represents a
+     * simulation sample, which is principally used to determine if truth
+     * information is available.
+     * @return void
+     */
+    void Analysis::AddTree(std::string name, RecoCut cut, TrueCut truth_cut, const std::vector<SelectedVar> & vars, bool is_sim)
+    {
+        std::vector<std::string> n;
+        for(const SelectedVar & v : vars)
+            n.push_back(v.name);
+        AddSortedTree(name, n, [name, cut, truth_cut, vars](SampleProfile * profile)
+        {
+            if(!profile)
+                return book_selected_vars(std::make_shared<SpillSelection>(cut, truth_cut), vars);
+            RecoCut c(profile_cut(cut, profile->Add(name, "cut", "cut")));
+            TrueCut t(profile_cut(truth_cut, profile->Add(name, "truth_cut", "truth_cut")));
+            return book_selected_vars(std::make_shared<SpillSelection>(c, t), vars);
+        }, is_sim, true);
+    }
+
+    /**
+     * @brief Add a selected Tree driven by the true interactions to the
+     * Analysis class.
+     * @details This function adds a new Tree whose columns are all evaluated
+     * over the true interactions passing a common truth cut and having a
+     * match. The selection is evaluated once per spill and shared by all
+     * columns of the Tree. Columns acting on the reco interaction are
+     * evaluated on the matched reco interaction. This is equivalent to, but
+     * much cheaper than, building each column with SPINEVAR_TT/SPINEVAR_TR
+     * using the same cut.
+     * @param name The name of the Tree.
+     * @param truth_cut The cut applied to each true interaction.
+     * @param vars The columns of the Tree (written in alphabetical order).
+     * @param is_sim A boolean indicating whether the Tree represents a
+     * simulation sample, which is principally used to determine if truth
+     * information is available.
+     * @return void
+     */
+    void Analysis::AddTruthTree(std::string name, TrueCut truth_cut, const std::vector<SelectedVar> & vars, bool is_sim)
+    {
+        std::vector<std::string> n;
+        for(const SelectedVar & v : vars)
+            n.push_back(v.name);
+        AddSortedTree(name, n, [name, truth_cut, vars](SampleProfile * profile)
+        {
+            if(!profile)
+                return book_selected_vars(std::make_shared<SpillSelection>(truth_cut), vars);
+            TrueCut t(profile_cut(truth_cut, profile->Add(name, "truth_cut", "truth_cut")));
+            return book_selected_vars(std::make_shared<SpillSelection>(t), vars);
+        }, is_sim, false);
+    }
+
+    /**
+     * @brief Add a fused selected Tree to the Analysis class.
+     * @details This function adds a new Tree whose cuts and columns are all
+     * known at compile time. The semantics are identical to those of the
+     * runtime @ref AddTree(std::string, RecoCut, TrueCut, const std::vector<SelectedVar> &, bool),
+     * but the selection and all columns are evaluated in a single loop over
+     * the reco interactions of each spill with no indirect calls per
+     * candidate. The types are typically declared with the SPINECUT_RECO,
+     * SPINECUT_TRUE, SPINECOLUMN_R, and SPINECOLUMN_T macros.
+     * @tparam Cut the type implementing the cut on each reco interaction.
+     * @tparam TruthCut the type implementing the cut on the true interaction
+     * matched to by each reco interaction (simulation only).
+     * @tparam Columns the types implementing the columns of the Tree (written
+     * in alphabetical order of their names).
+     * @param name The name of the Tree.
+     * @param is_sim A boolean indicating whether the Tree represents a
+     * simulation sample, which is principally used to determine if truth
+     * information is available.
+     * @return void
+     */
+    template<class Cut, class TruthCut, class... Columns>
+        void Analysis::AddTree(std::string name, bool is_sim)
+        {
+            typedef FusedSelection<false, Cut, TruthCut, Columns...> selection_t;
+            AddSortedTree(name, selection_t::Names(), [name](SampleProfile * profile) { return book_fused_vars<selection_t>(profile, name); }, is_sim, true);
+            trees.back().profiles_columns = true;
+        }
+
+    /**
+     * @brief Add a fused selected Tree driven by the true interactions to the
+     * Analysis class.
+     * @details This function is the compile-time counterpart of
+     * @ref AddTruthTree(std::string, TrueCut, const std::vector<SelectedVar> &, bool).
+     * The selection and all columns are evaluated in a single loop over the
+     * true interactions of each spill.
+     * @tparam TruthCut the type implementing the cut on each true interaction.
+     * @tparam Columns the types implementing the columns of the Tree (written
+     * in alphabetical order of their names).
+     * @param name The name of the Tree.
+     * @param is_sim A boolean indicating whether the Tree represents a
+     * simulation sample, which is principally used to determine if truth
+     * information is available.
+     * @return void
+     */
+    template<class TruthCut, class... Columns>
+        void Analysis::AddTruthTree(std::string name, bool is_sim)
+        {
+            typedef FusedSelection<true, NoRecoCut, TruthCut, Columns...> selection_t;
+            AddSortedTree(name, selection_t::Names(), [name](SampleProfile * profile) { return book_fused_vars<selection_t>(profile, name); }, is_sim, false);
+            trees.back().profiles_columns = true;
+        }
+
+    /**
+     * @brief Configure the number of samples that are run concurrently.
+     * @details This function enables the parallel execution mode of the
+     * Analysis class. Each worker thread picks up the next sample that has
+     * not yet been started, fills its own set of Trees for that sample, and
+     * then writes them to the output file. The SpectrumLoaders of the samples
+     * are fully independent of each other, so no state is shared between
+     * the workers other than the output file, to which access is serialized.
+     * A value of 1 (the default) restores the sequential behavior.
+     * @param nworkers The maximum number of samples to run concurrently.
+     * @return void
+     */
+    void Analysis::SetParallel(size_t nworkers)
+    {
+        this->nworkers = std::max<size_t>(nworkers, 1);
+    }
+
+    /**
+     * @brief Enable the columnar export of the Trees.
+     * @details This function enables the export of each Tree of each sample
+     * as a set of NumPy (.npy) files, one per branch, in addition to the
+     * TTrees of the output ROOT file. The export is written to
+     * "<name>.columns/<sample>/<tree>/", next to the ROOT output, and can be
+     * memory-mapped by spineplot so that only the columns used by a plot are
+     * read. The export of a sample is removed whenever the sample is
+     * rewritten, and is tied to the ROOT output by a stamp stored both in
+     * "<name>.columns/<sample>/stamp" and as the TNamed "columns" of the
+     * sample directory. spineplot only reads an export whose stamps match,
+     * so the export of a sample later rewritten without it is ignored.
+     * @param compact Whether to write the (double) variables as float32.
+     * @return void
+     * @see write_columns()
+     */
+    void Analysis::SetColumnarOutput(bool compact)
+    {
+        this->columnar = true;
+        this->compact = compact;
+    }
+
+    /**
+     * @brief Set the version tag of a Tree.
+     * @details The version tag is part of the manifest of each sample, so
+     * changing it forces the samples filling the Tree to be reprocessed by an
+     * incremental run. It should be changed whenever the definition of a
+     * variable of the Tree changes without a change of its name.
+     * @param tree The name of the Tree.
+     * @param version The version tag of the Tree.
+     * @return void
+     */
+    void Analysis::SetVersion(std::string tree, std::string version)
+    {
+        for(TreeSet & t : trees)
+        {
+            if(t.name == tree)
+                t.version = version;
+        }
+    }
+
+    /**
+     * @brief Configure the reuse of unchanged samples from a previous run.
+     * @details If enabled and the output file of a previous run exists, each
+     * sample whose manifest (see @ref Manifest()) matches the manifest stored
+     * in the previous output file is copied from the previous output file
+     * instead of being reprocessed. All other samples are reprocessed. The
+     * new output file replaces the previous one once the run is complete.
+     * @param incremental Whether to reuse unchanged samples.
+     * @return void
+     */
+    void Analysis::SetIncremental(bool incremental)
+    {
+        this->incremental = incremental;
+    }
+
+    /**
+     * @brief Configure the appending of new columns to an existing output.
+     * @details If enabled, the output file of a previous run is updated in
+     * place instead of being recreated. For each Tree of each sample, only
+     * the columns that are missing from the existing Tree are computed, and
+     * they are written to a friend tree "<tree>_friend" in the same
+     * directory, aligned entry-by-entry with the existing Tree (see
+     * @ref write_friend_tree()). The friend tree is not attached to the
+     * existing Tree in the file, so readers attach it themselves with
+     * TTree::AddFriend() (e.g. tree->AddFriend("<tree>_friend")). Trees that
+     * do not exist in the output file yet are written in full, and Trees
+     * without new columns are skipped. The friend tree always holds all
+     * columns missing from the existing Tree, so it is simply overwritten
+     * when more columns are added later.
+     * @note The alignment uses the Run, Subrun, Evt, and (if it is a column
+     * of the Tree) nu_id of each entry, which are computed alongside the new
+     * columns. The selection of a fused Tree still evaluates all its columns.
+     * @param friends Whether to append new columns as friend trees.
+     * @return void
+     */
+    void Analysis::SetFriendMode(bool friends)
+    {
+        this->friends = friends;
+    }
+
+    /**
+     * @brief Configure a spill-level preselection for the reco-driven Trees.
+     * @details The preselection is evaluated once per spill (per Tree), and
+     * spills failing it are rejected before any column of the Tree is
+     * evaluated (see @ref SpillPreselection). It must be implied by the cuts
+     * of every Tree it gates, so that it only rejects spills that would not
+     * have produced any entries. The truth-driven Trees (see
+     * @ref AddTruthTree()) are not gated, since a reco-level preselection
+     * would bias their efficiencies. Whether a Tree is gated may be changed
+     * with @ref SetPreselection() (e.g. for a truth-driven Tree built with
+     * the SPINEVAR macros). The selected Trees already evaluate their
+     * interaction cut once per spill, so the preselection mostly benefits
+     * Trees built with the SPINEVAR macros.
+     * @note The preselection gates the columns rather than being passed as
+     * the SpillCut of the CAFAna Trees, so the exposure (POT and livetime)
+     * accounted for each Tree is unchanged.
+     * @param cut The spill-level preselection (e.g. the result of
+     * @ref any_interaction()).
+     * @return void
+     */
+    void Analysis::SetSpillCut(SpillPrecut cut)
+    {
+        this->spill_cut = cut;
+    }
+
+    /**
+     * @brief Set whether a Tree is gated by the spill-level preselection.
+     * @details By default, all Trees except the truth-driven Trees are
+     * gated (see @ref SetSpillCut()).
+     * @param tree The name of the Tree.
+     * @param preselect Whether the Tree is gated by the preselection.
+     * @return void
+     */
+    void Analysis::SetPreselection(std::string tree, bool preselect)
+    {
+        for(TreeSet & t : trees)
+        {
+            if(t.name == tree)
+                t.preselect = preselect;
+        }
+    }
+
+    /**
+     * @brief Configure the profiling of the samples.
+     * @details If enabled, each column of each Tree, the cuts of the
+     * selected Trees, and the spill-level preselection are wrapped with a
+     * counter recording the calls, the interactions visited, the entries
+     * emitted, and the cumulative time (see @ref SampleProfile). The wall
+     * time, the number of spills, and the bytes read are recorded for each
+     * sample. The profile of each sample is printed once the sample is
+     * complete, and written to "profile/<sample>" in the output file.
+     * The cuts and columns of a fused Tree are timed within its fused loop,
+     * so each is charged only with its own evaluations.
+     * @note The time of a (runtime) selected Tree's selection is included in
+     * the time of the first column evaluated in each spill, and the
+     * interaction cuts of the SPINEVAR macros are included in the time of
+     * their columns. The SpectrumLoader does not expose its files, so the
+     * bytes read are counted for the whole process. They are only exact per
+     * sample when the samples are run sequentially, and the report flags
+     * them as shared otherwise.
+     * @param profiling Whether to profile the samples.
+     * @return void
+     */
+    void Analysis::SetProfiling(bool profiling)
+    {
+        this->profiling = profiling;
+    }
+
+    /**
+     * @brief Configure the shard of the input files processed by this job.
+     * @details In shard mode, each sample processes only the index-th of
+     * count contiguous blocks of its (sorted) input files (see
+     * @ref shard_files()), and the output is written to
+     * "<name>_shard<index>of<count>.root" (and the columnar export, if any,
+     * next to it). The outputs of all shards are combined with
+     * @ref merge_shards() (see macros/merge.C), which yields the same Trees
+     * and exposure as a single job over all files. All samples must have
+     * been added with their input files (a file path or wildcard). A count
+     * of 1 (the default) disables shard mode.
+     * @param index The index of the shard (0 <= index < count).
+     * @param count The number of shards.
+     * @return void
+     * @throw std::invalid_argument if the shard is invalid.
+     */
+    void Analysis::SetShard(size_t index, size_t count)
+    {
+        if(count == 0 || index >= count)
+            throw std::invalid_argument("Invalid shard " + std::to_string(index) + "/" + std::to_string(count) + ".");
+        this->shard = index;
+        this->nshards = count;
+    }
+
+    /**
+     * @brief Configure the shard of the input files processed by this job.
+     * @details This is a convenience overload of @ref SetShard(size_t, size_t)
+     * accepting the shard as a string of the form "i/N", e.g. as passed to a
+     * grid job on the command line or in an environment variable.
+     * @param spec The shard specification.
+     * @return void
+     * @throw std::invalid_argument if the specification is malformed.
+     */
+    void Analysis::SetShard(const std::string & spec)
+    {
+        size_t index, count;
+        parse_shard(spec, index, count);
+        SetShard(index, count);
+    }
+
+    /**
+     * @brief Configure the skimming of the input files instead of the
+     * filling of the Trees.
+     * @details If enabled, @ref Go() writes a skimmed copy of each input file
+     * of each sample to "<name>.skim/<sample>/" (see @ref skim_file()),
+     * keeping only the spills that pass the spill-level preselection (see
+     * @ref SetSpillCut()). Later runs add the skimmed files with
+     * @ref AddSkim() and report the exposure of the full input files. The
+     * skimmed files keep the names of the input files, so the shards of a
+     * sharded skim (see @ref SetShard()) write to the same directory and need
+     * no merging.
+     * @param skimming Whether to skim the input files.
+     * @return void
+     */
+    void Analysis::SetSkimMode(bool skimming)
+    {
+        this->skimming = skimming;
+    }
+
+    /**
+     * @brief Configure the streaming of the Trees to the output file.
+     * @details By default, each Tree of a sample holds all its entries in
+     * memory until the sample is complete. If enabled, the entries are
+     * instead filled directly into the TTree in the output file (see
+     * @ref StreamingTree) and flushed incrementally according to the write
+     * options of the Tree (see @ref SetWriteOptions()), so the memory usage
+     * does not grow with the size of the sample. The Trees are written with
+     * the same branches and exposure. Friend trees (see
+     * @ref SetFriendMode()) are not streamed, as they are aligned to the
+     * existing Tree once complete.
+     * @param streaming Whether to stream the Trees to the output file.
+     * @return void
+     */
+    void Analysis::SetStreaming(bool streaming)
+    {
+        this->streaming = streaming;
+    }
+
+    /**
+     * @brief Set the write options of a streamed Tree.
+     * @param tree The name of the Tree.
+     * @param basket_size The basket size (bytes) of each branch.
+     * @param compression The compression setting of each branch (100 *
+     * algorithm + level, or negative for the setting of the output file).
+     * @param autoflush The auto-flush setting of the TTree (negative for a
+     * number of bytes, positive for a number of entries).
+     * @return void
+     */
+    void Analysis::SetWriteOptions(std::string tree, int basket_size, int compression, long long autoflush)
+    {
+        for(TreeSet & t : trees)
+        {
+            if(t.name == tree)
+                t.options = {basket_size, compression, autoflush};
+        }
+    }
+
+    /**
+     * @brief Set the storage type of a column of a Tree.
+     * @details All variables are computed as doubles, but most columns (flags,
+     * categories, identifiers, and kinematics) do not need double precision
+     * on disk. The storage type is applied when the Tree is written, either
+     * by the streaming tree or by converting the TTree written by CAFAna, so
+     * it does not change the values seen by the cuts and variables. Integer
+     * types round to the nearest integer, and a value the type cannot
+     * represent (e.g. utilities::kUnmatched in a Bool column) fails the
+     * write of the Tree (see @ref representable()). The Run, Subrun, and Evt
+     * identifying an entry are always stored as Int_t. The nu_id is not
+     * affected by the default type of the Tree and is stored as a double
+     * unless it is given a type explicitly (see @ref column_type()). The
+     * columns of friend trees (see @ref SetFriendMode()) are always stored
+     * as doubles.
+     * @param tree The name of the Tree.
+     * @param column The name of the column, or an empty name to set the
+     * default type of the columns of the Tree.
+     * @param type The storage type of the column.
+     * @return void
+     */
+    void Analysis::SetColumnType(std::string tree, std::string column, ColumnType type)
+    {
+        for(TreeSet & t : trees)
+        {
+            if(t.name == tree)
+                t.types[column] = type;
+        }
+    }
+
+    /**
+     * @brief Configure the read-ahead of the input files of the samples.
+     * @details If enabled, the next input files of each sample are opened
+     * and read on a background thread while the current file is processed
+     * (see @ref Prefetcher), so that the processing is not stalled by the
+     * latency of the storage. The read-ahead requires the input files of the
+     * sample (see @ref AddLoader()), and samples added with an existing
+     * SpectrumLoader are not prefetched. The bytes read by the read-ahead
+     * are not counted in the profile of the sample.
+     * @param depth The number of files to warm ahead of the file being
+     * processed (zero disables the read-ahead).
+     * @param cache_size The number of bytes to read from each file (the
+     * whole file if not positive).
+     * @return void
+     */
+    void Analysis::SetPrefetch(size_t depth, long long cache_size)
+    {
+        this->prefetch_depth = depth;
+        this->prefetch_size = cache_size;
+    }
+
+    /**
+     * @brief Get the name (without extension) of the output of this job.
+     * @return The name of the Analysis, or the name of the output of the
+     * shard in shard mode.
+     */
+    std::string Analysis::OutputName() const
+    {
+        return nshards > 1 ? shard_output_name(name, shard, nshards) : name;
+    }
+
+    /**
+     * @brief Compute the manifest of a sample.
+     * @details The manifest is a hash of the input files of the sample (see
+     * @ref hash_input_files()) and of the schema (name, version, variable
+     * names, and storage types) of each Tree filled for the sample. Only
+     * the storage types other than double are hashed, so the manifests of
+     * Trees without any storage types are unchanged. In shard mode, only
+     * the input files of the shard are hashed. The manifest is
+     * empty if the input files of the sample are unknown or do not exist, in
+     * which case the sample is never reused.
+     * @param s The sample.
+     * @return The manifest of the sample.
+     */
+    std::string Analysis::Manifest(const Sample & s) const
+    {
+        ManifestHash hash;
+        if(s.source.empty() || hash_input_files(nshards > 1 ? s.files : expand_source(s.source), hash) == 0)
+            return "";
+        hash.Add(s.is_sim ? "sim" : "data");
+        for(const TreeSet & t : trees)
+        {
+            if(t.is_sim && !s.is_sim)
+                continue;
+            hash.Add(t.name).Add(t.version);
+            for(const std::string & n : t.names)
+            {
+                hash.Add(n);
+                if(column_type(t.types, n) != ColumnType::Double)
+                    hash.Add(column_type_name(column_type(t.types, n)));
+            }
+        }
+        return "fnv1a64:" + hash.Hex();
+    }
+
+    /**
+     * @brief Skim the input files of all samples.
+     * @details The input files (of the shard, in shard mode) of each sample
+     * are skimmed one after another with the spill-level preselection.
+     * @return void
+     * @throw std::runtime_error if no preselection is configured, if a sample
+     * was added without (or without any matching) input files, or if two
+     * input files of a sample share a name.
+     */
+    void Analysis::Skim()
+    {
+        if(!spill_cut)
+            throw std::runtime_error("Skim mode requires a spill-level preselection (see SetSpillCut()).");
+        for(const Sample & s : samples)
+        {
+            if(s.source.empty())
+                throw std::runtime_error("Skim mode requires the input files of sample " + s.name + " (see AddLoader()).");
+            std::vector<std::string> files(expand_source(s.source));
+            if(files.empty())
+                throw std::runtime_error("Skim mode found no input files for sample " + s.name + ".");
+            if(nshards > 1)
+                files = shard_files(files, shard, nshards);
+            std::string dir(name + ".skim/" + s.name);
+            gSystem->mkdir(dir.c_str(), true);
+            std::set<std::string> outputs;
+            size_t nkept(0);
+            for(const std::string & f : files)
+            {
+                std::string output(dir + "/" + f.substr(f.find_last_of('/') + 1));
+                if(!outputs.insert(output).second)
+                    throw std::runtime_error("Duplicate input file name " + output + " in sample " + s.name + ".");
+                nkept += skim_file(f, output, spill_cut);
+            }
+            std::cout << "Skimmed sample " << s.name << ": kept " << nkept << " spills of " << files.size() << " files." << std::endl;
+        }
+    }
+
+    /**
+     * @brief Run the analysis on a single sample.
+     * @details This function creates the Trees for the sample, runs the
+     * SpectrumLoader of the sample to populate the Trees, and then writes the
+     * Trees to the sample subdirectory of the output file. The write is
+     * guarded by the output mutex so that multiple samples may be run
+     * concurrently while sharing the same output TFile. If the columnar
+     * export is enabled, the written TTrees are then exported (under the
+     * same lock) with @ref write_columns(). If profiling is enabled, the
+     * profile of the sample is written to the profile directory. The exposure
+     * of a skimmed sample is replaced by that of its full input files. The
+     * manifest of the sample is written last, so only a sample that has been
+     * run and written completely is reused by a later incremental run.
+     * @param s The sample to run.
+     * @param subdir The subdirectory of the output file for the sample.
+     * @param profdir The profile subdirectory of the output file for the
+     * sample (nullptr if profiling is disabled).
+     * @param manifest The manifest of the sample (empty if none is stored).
+     * @param output_mutex The mutex guarding access to the output file.
+     * @return void
+     */
+    void Analysis::RunSample(const Sample & s, TDirectory * subdir, TDirectory * profdir, const std::string & manifest, std::mutex & output_mutex)
+    {
+        std::unique_ptr<SampleProfile> profile(profiling ? new SampleProfile : nullptr);
+        std::unique_ptr<Prefetcher> prefetcher;
+        if(prefetch_depth > 0 && !s.source.empty())
+            prefetcher = std::make_unique<Prefetcher>(nshards > 1 ? s.files : expand_source(s.source), prefetch_depth, prefetch_size);
+
+        /**
+         * @brief Book the Trees of the sample.
+         * @details In friend mode, the columns of each Tree are reduced to
+         * those missing from the existing Tree (plus the nu_id used for the
+         * alignment), and the existing Tree is remembered as the reference of
+         * the friend tree.
+         */
+        struct booked_t
+        {
+            const TreeSet * set;
+            ana::Tree * tree;
+            std::vector<std::string> columns;
+            TTree * existing;
+            StreamingTree * stream;
+        };
+        std::vector<booked_t> booked;
+        std::vector<std::unique_ptr<StreamingTree>> streams;
+        for(const TreeSet & t : trees)
+        {
+            if(t.is_sim && !s.is_sim)
+                continue;
+            std::vector<std::string> names(t.names);
+            std::vector<ana::SpillMultiVar> vars(t.book(profile.get()));
+            TTree * existing = nullptr;
+            if(friends)
+            {
+                std::lock_guard<std::mutex> lock(output_mutex);
+                existing = subdir->Get<TTree>(t.name.c_str());
+            }
+            std::vector<std::string> columns;
+            if(existing)
+            {
+                std::vector<std::string> n;
+                std::vector<ana::SpillMultiVar> v;
+                for(size_t c(0); c < names.size(); ++c)
+                {
+                    bool is_new(!existing->GetBranch(names[c].c_str()));
+                    if(is_new)
+                        columns.push_back(names[c]);
+                    if(is_new || names[c] == "nu_id")
+                    {
+                        n.push_back(names[c]);
+                        v.push_back(vars[c]);
+                    }
+                }
+                if(columns.empty())
+                    continue;
+                names.swap(n);
+                vars.swap(v);
+            }
+            if(profile && !t.profiles_columns)
+            {
+                for(size_t c(0); c < vars.size(); ++c)
+                    vars[c] = profile_var(vars[c], profile->Add(t.name, names[c], "column"));
+            }
+            if(spill_cut && t.preselect)
+            {
+                SpillPrecut cut(profile ? profile_spill_cut(spill_cut, profile->Add(t.name, "preselection", "spill_cut")) : spill_cut);
+                vars = book_preselected_vars(std::make_shared<SpillPreselection>(cut), vars);
+            }
+            if(profile && booked.empty() && !vars.empty())
+                vars[0] = count_spills(vars[0], profile->spills);
+            if(prefetcher && booked.empty() && !vars.empty())
+                vars[0] = prefetcher->Track(vars[0]);
+            if(!vars.empty())
+                vars[0] = track_spills(vars[0]);
+            if(streaming && !existing)
+            {
+                streams.push_back(std::make_unique<StreamingTree>(t.name, names, vars, t.types, subdir, t.options, output_mutex));
+                booked.push_back({&t, new ana::Tree(t.name, {"stream"}, *s.loader, {streams.back()->Driver()}, ana::kNoSpillCut, false), columns, nullptr, streams.back().get()});
+            }
+            else
+                booked.push_back({&t, new ana::Tree(t.name, names, *s.loader, vars, ana::kNoSpillCut, true), columns, existing, nullptr});
+        }
+        profile_clock_t::time_point start(profile_clock_t::now());
+        long long bytes(TFile::GetFileBytesRead());
+        utilities::reset_spills();
+        s.loader->Go();
+        utilities::reset_spills();
+        double wall(elapsed_ns(start) / 1e9);
+        if(prefetcher)
+        {
+            prefetcher->Stop();
+            bytes += prefetcher->BytesRead();
+        }
+        if(profile)
+        {
+            profile->wall = wall;
+            profile->bytes = TFile::GetFileBytesRead() - bytes;
+            profile->shared_bytes = std::min(nworkers, samples.size()) > 1;
+        }
+
+        /**
+         * @brief Write the Trees (or friend trees) of the sample.
+         * @details The Tree backing a friend tree is first saved to a
+         * scratch in-memory file, from which the aligned friend tree is
+         * written. A streamed Tree is already in the output file, and only
+         * the exposure of its (empty) driving Tree is copied from a scratch
+         * in-memory file. A Tree with storage types other than double is
+         * likewise saved to a scratch in-memory file and converted.
+         */
+        std::lock_guard<std::mutex> lock(output_mutex);
+
+        /**
+         * @brief Start the columnar export of the sample.
+         * @details The previous export of the sample is removed and a new
+         * stamp is created. In friend mode, the columns are instead added to
+         * the previous export if its stamp matches the one of the existing
+         * output, and the friend trees are not exported otherwise (since the
+         * export would lack the columns of the existing Trees).
+         */
+        std::string export_path(OutputName() + ".columns/" + s.name);
+        std::string stamp;
+        if(columnar && !booked.empty())
+        {
+            TNamed * existing = friends ? subdir->Get<TNamed>("columns") : nullptr;
+            if(existing && read_column_stamp(export_path) == existing->GetTitle())
+                stamp = existing->GetTitle();
+            else if(friends)
+                std::cerr << "Warning: No valid columnar export of sample " << s.name << " to add the friend trees to." << std::endl;
+            else
+            {
+                remove_columns(export_path);
+                stamp = make_column_stamp();
+            }
+        }
+        for(booked_t & b : booked)
+        {
+            std::string tname(b.set->name);
+            if(b.stream)
+            {
+                b.stream->Finish();
+                TMemFile scratch((s.name + "_" + tname + "_scratch.root").c_str(), "RECREATE");
+                b.tree->SaveTo(&scratch);
+                for(const char * e : {"POT", "Livetime"})
+                    subdir->WriteObject(scratch.Get<TH1>(e), e, "WriteDelete");
+                scratch.Close();
+            }
+            else if(b.existing)
+            {
+                TMemFile scratch((s.name + "_" + tname + "_scratch.root").c_str(), "RECREATE");
+                b.tree->SaveTo(&scratch);
+                tname += "_friend";
+                write_friend_tree(b.existing, scratch.Get<TTree>(b.set->name.c_str()), b.columns, subdir, tname);
+                scratch.Close();
+            }
+            else if(has_column_types(b.set->types, b.set->names))
+            {
+                TMemFile scratch((s.name + "_" + tname + "_scratch.root").c_str(), "RECREATE");
+                b.tree->SaveTo(&scratch);
+                write_typed_tree(scratch.Get<TTree>(tname.c_str()), b.set->types, subdir, tname);
+                for(const char * e : {"POT", "Livetime"})
+                    subdir->WriteObject(scratch.Get<TH1>(e), e, "WriteDelete");
+                scratch.Close();
+            }
+            else
+                b.tree->SaveTo(subdir);
+            delete b.tree;
+
+            /**
+             * @brief Export the written Tree as columns. The columns of a
+             * friend tree are added to the export of its existing Tree.
+             */
+            TTree * saved = stamp.empty() ? nullptr : subdir->Get<TTree>(tname.c_str());
+            if(saved)
+                write_columns(saved, export_path + "/" + b.set->name, compact);
+        }
+        if(!stamp.empty())
+        {
+            write_column_stamp(export_path, stamp);
+            subdir->WriteTObject(new TNamed("columns", stamp.c_str()), "columns", "WriteDelete");
+        }
+        if(s.skim && !booked.empty())
+        {
+            std::vector<std::string> files(nshards > 1 ? s.files : expand_source(s.source));
+            for(const char * e : {"POT", "Livetime"})
+            {
+                TH1 * exposure = skim_exposure(files, e);
+                subdir->WriteObject(exposure, e, "WriteDelete");
+                delete exposure;
+            }
+        }
+        if(profile)
+        {
+            profile->Print(s.name);
+            profile->Write(profdir);
+        }
+        if(!manifest.empty())
+            subdir->WriteTObject(new TNamed("manifest", manifest.c_str()), "manifest");
     }
 
     /**
@@ -165,35 +1092,203 @@ namespace ana
      * running the analysis on the sample to populate the Trees with the
      * results of the analysis. The results are stored in a TFile in the output
      * ROOT file in a parent directory named "events" and a subdirectory for
-     * each sample.
+     * each sample. If more than one worker has been requested with
+     * @ref SetParallel(), the samples are distributed over a pool of worker
+     * threads. The sample subdirectories are always created up front in the
+     * order the samples were added, so the layout of the output file does not
+     * depend on the order in which the samples finish. Each sample directory
+     * stores the manifest of the sample, and samples that are unchanged since
+     * the previous run are copied instead of reprocessed if requested with
+     * @ref SetIncremental() (their columnar export, if any, is left as is).
+     * In friend mode (see @ref SetFriendMode()), the existing output file is
+     * updated in place with the new columns instead. The profiles of the
+     * samples (see @ref SetProfiling()) are stored in a parent directory
+     * named "profile". In shard mode (see @ref SetShard()), only the input
+     * files of the shard are processed, and samples without any input files
+     * in the shard are left empty. In skim mode (see @ref SetSkimMode()), the
+     * input files are skimmed instead and no output file is written.
      * @return void
+     * @throw std::runtime_error if shard mode is requested for a sample added
+     * with an existing SpectrumLoader or without any matching input files.
+     * The exception of a failed sample is rethrown once the output file is
+     * closed (and, in incremental mode, its temporary output removed).
      */
     void Analysis::Go()
     {
-        TFile * f = new TFile(std::string(name + ".root").c_str(), "RECREATE");
-        TDirectory * dir = f->mkdir("events");
+        if(skimming)
+        {
+            Skim();
+            return;
+        }
+        if(std::min(nworkers, samples.size()) > 1 || prefetch_depth > 0)
+            ROOT::EnableThreadSafety();
+
+        /**
+         * @brief Create the SpectrumLoaders of the samples added with their
+         * input files (restricted to the files of the shard in shard mode).
+         */
+        for(Sample & s : samples)
+        {
+            if(nshards > 1)
+            {
+                if(s.source.empty())
+                    throw std::runtime_error("Shard mode requires the input files of sample " + s.name + " (see AddLoader()).");
+                std::vector<std::string> all(expand_source(s.source));
+                if(all.empty())
+                    throw std::runtime_error("Shard mode found no input files for sample " + s.name + ".");
+                s.files = shard_files(all, shard, nshards);
+                if(!s.files.empty())
+                {
+                    loaders.push_back(std::make_unique<ana::SpectrumLoader>(s.files));
+                    s.loader = loaders.back().get();
+                }
+            }
+            else if(!s.loader)
+            {
+                loaders.push_back(std::make_unique<ana::SpectrumLoader>(s.source));
+                s.loader = loaders.back().get();
+            }
+        }
+
+        /**
+         * @brief Open the previous output file of an incremental run.
+         * @details The new output file is written next to the previous one
+         * and only replaces it once the run is complete.
+         */
+        std::string path(OutputName() + ".root");
+        if(friends && gSystem->AccessPathName(path.c_str()))
+            throw std::runtime_error("Friend mode requires the existing output file " + path + ".");
+        TFile * previous = nullptr;
+        if(incremental && !friends && !gSystem->AccessPathName(path.c_str()))
+            previous = TFile::Open(path.c_str(), "READ");
+        std::string output_path(previous ? path + ".tmp" : path);
+
+        TFile * f = new TFile(output_path.c_str(), friends ? "UPDATE" : "RECREATE");
+        TDirectory * dir = f->GetDirectory("events");
+        if(!dir)
+            dir = f->mkdir("events");
         dir->cd();
 
+        std::vector<TDirectory *> subdirs;
         for(const Sample & s : samples)
         {
-            TDirectory * subdir = dir->mkdir(s.name.c_str());
-            subdir->cd();
-            std::vector<ana::Tree*> sbruce_trees;
-            for(const TreeSet & t : trees)
+            TDirectory * subdir = dir->GetDirectory(s.name.c_str());
+            subdirs.push_back(subdir ? subdir : dir->mkdir(s.name.c_str()));
+        }
+
+        std::vector<TDirectory *> profdirs(samples.size(), nullptr);
+        if(profiling)
+        {
+            TDirectory * pdir = f->GetDirectory("profile");
+            if(!pdir)
+                pdir = f->mkdir("profile");
+            for(size_t i(0); i < samples.size(); ++i)
             {
-                if(t.is_sim && !s.is_sim)
-                    continue;
-                sbruce_trees.push_back(new ana::Tree(t.name, t.names, *s.loader, t.vars, ana::kNoSpillCut, true));
+                profdirs[i] = pdir->GetDirectory(samples[i].name.c_str());
+                if(!profdirs[i])
+                    profdirs[i] = pdir->mkdir(samples[i].name.c_str());
             }
-            s.loader->Go();
-            for(const ana::Tree * t : sbruce_trees)
+        }
+
+        /**
+         * @brief Reuse the unchanged samples.
+         * @details Samples whose manifest matches the one stored in the
+         * previous output file are copied (including their manifest), and
+         * all other samples are queued for processing. The manifest of a
+         * queued sample is only written once the sample has been run (see
+         * @ref RunSample()), while a sample without input files (in shard
+         * mode) is complete as is.
+         */
+        std::vector<size_t> queue;
+        std::vector<std::string> manifests(samples.size());
+        for(size_t i(0); i < samples.size(); ++i)
+        {
+            std::string & manifest(manifests[i]);
+            manifest = friends ? "" : Manifest(samples[i]);
+            TDirectory * old = previous ? previous->GetDirectory(("events/" + samples[i].name).c_str()) : nullptr;
+            TNamed * stored = old ? old->Get<TNamed>("manifest") : nullptr;
+            if(!manifest.empty() && stored && manifest == stored->GetTitle())
+            {
+                std::cout << "Reusing unchanged sample " << samples[i].name << "." << std::endl;
+                copy_directory(old, subdirs[i]);
+                continue;
+            }
+            if(samples[i].loader)
+                queue.push_back(i);
+            else if(!manifest.empty())
+                subdirs[i]->WriteTObject(new TNamed("manifest", manifest.c_str()), "manifest");
+        }
+        if(previous)
+            previous->Close();
+
+        size_t npool(std::min(nworkers, queue.size()));
+        std::mutex output_mutex;
+        std::exception_ptr error(nullptr);
+        if(npool > 1)
+        {
+            /**
+             * @brief Run the samples on a bounded pool of worker threads.
+             * @details Each worker repeatedly claims the next unstarted sample
+             * until all samples have been claimed. Exceptions thrown by a
+             * worker are captured and rethrown once all workers have joined.
+             */
+            std::atomic<size_t> next(0);
+            std::mutex error_mutex;
+            auto worker = [&]()
+            {
+                for(size_t q(next++); q < queue.size(); q = next++)
+                {
+                    size_t i(queue[q]);
+                    try
+                    {
+                        RunSample(samples[i], subdirs[i], profdirs[i], manifests[i], output_mutex);
+                    }
+                    catch(...)
+                    {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        if(!error) error = std::current_exception();
+                    }
+                }
+            };
+            std::vector<std::thread> pool;
+            for(size_t w(0); w < npool; ++w)
+                pool.emplace_back(worker);
+            for(std::thread & t : pool)
+                t.join();
+        }
+        else
+        {
+            try
+            {
+                for(size_t i : queue)
+                    RunSample(samples[i], subdirs[i], profdirs[i], manifests[i], output_mutex);
+            }
+            catch(...)
             {
-                t->SaveTo(subdir);
-                delete t;
+                error = std::current_exception();
             }
-            dir->cd();
         }
+
+        /**
+         * @brief Close the output file and rethrow the error of a failed run.
+         * @details The failed samples carry no manifest (see
+         * @ref RunSample()), so they are never reused. The temporary output
+         * of an incremental run is removed, which leaves the previous output
+         * file untouched.
+         */
+        if(error)
+        {
+            f->Close();
+            delete f;
+            if(previous)
+                std::remove(output_path.c_str());
+            std::rethrow_exception(error);
+        }
+        dir->cd();
         f->Close();
+        delete f;
+        if(previous)
+            std::rename(output_path.c_str(), path.c_str());
     }
 }
 #endif // ANALYSIS_H
\ No newline at end of file
@@ -0,0 +1,156 @@
+/**
+ * @file cache.h
+ * @brief Header file for the helpers used by the Analysis class to reuse the
+ * output of unchanged samples between runs.
+ * @details Each sample directory of the output file carries a manifest: a
+ * hash of the input files of the sample (paths, sizes, and modification
+ * times) and of the schema of the Trees filled for the sample. When running
+ * incrementally, a sample whose manifest matches the one stored in the
+ * previous output file is copied from the previous output file instead of
+ * being reprocessed. This file provides the hashing of the inputs and the
+ * copying of a sample directory between files.
+ * @author mueller@fnal.gov
+ */
+#ifndef CACHE_H
+#define CACHE_H
+#include <vector>
+#include <string>
+#include <set>
+#include <cstdint>
+#include <cstdio>
+#include <glob.h>
+#include <sys/stat.h>
+
+#include "TDirectory.h"
+#include "TKey.h"
+#include "TList.h"
+#include "TTree.h"
+
+namespace ana
+{
+    /**
+     * @class ManifestHash
+     * @brief A simple (non-cryptographic) 64-bit FNV-1a hash for manifests.
+     * @details Strings are hashed with a terminating separator so that the
+     * concatenation of different fields can not collide trivially.
+     */
+    class ManifestHash
+    {
+        public:
+            ManifestHash() : value(14695981039346656037ULL) {}
+
+            /**
+             * @brief Add a string to the hash.
+             * @param s The string to add.
+             * @return A reference to the hash (for chaining).
+             */
+            ManifestHash & Add(const std::string & s)
+            {
+                for(unsigned char c : s)
+                    Mix(c);
+                Mix(0x1f);
+                return *this;
+            }
+
+            /**
+             * @brief Get the hash as a hexadecimal string.
+             * @return The hash.
+             */
+            std::string Hex() const
+            {
+                char buffer[17];
+                std::snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long) value);
+                return std::string(buffer);
+            }
+
+        private:
+            void Mix(unsigned char c)
+            {
+                value ^= c;
+                value *= 1099511628211ULL;
+            }
+            uint64_t value;
+    };
+
+    /**
+     * @brief Expand the source of a sample into its (sorted) input files.
+     * @param source The file path or wildcard of the sample, as passed to
+     * the SpectrumLoader.
+     * @return The input files of the sample (empty if none match, e.g. for
+     * a SAM dataset).
+     */
+    std::vector<std::string> expand_source(const std::string & source)
+    {
+        std::vector<std::string> files;
+        glob_t matches;
+        if(glob(source.c_str(), 0, nullptr, &matches) == 0)
+        {
+            for(size_t i(0); i < matches.gl_pathc; ++i)
+                files.push_back(matches.gl_pathv[i]);
+        }
+        globfree(&matches);
+        return files;
+    }
+
+    /**
+     * @brief Hash the input files of a sample.
+     * @details The path, size, and modification time of each file are added
+     * to the hash, so replacing, adding, or removing any file changes the
+     * hash.
+     * @param files The input files of the sample (see @ref expand_source()).
+     * @param hash The hash to add the files to.
+     * @return The number of (existing) files added to the hash.
+     */
+    size_t hash_input_files(const std::vector<std::string> & files, ManifestHash & hash)
+    {
+        size_t nfiles(0);
+        for(const std::string & file : files)
+        {
+            struct stat info;
+            if(stat(file.c_str(), &info) != 0)
+                continue;
+            hash.Add(file).Add(std::to_string(info.st_size)).Add(std::to_string(info.st_mtime));
+            ++nfiles;
+        }
+        return nfiles;
+    }
+
+    /**
+     * @brief Copy the contents of a directory to another directory.
+     * @details All objects of the source directory are copied (recursively
+     * for subdirectories). TTrees are copied at the basket level (without
+     * decompression), and all other objects are read and re-written. Only the
+     * highest cycle of each key (the first in the list of keys) is copied.
+     * @param from The source directory.
+     * @param to The destination directory.
+     * @return void
+     */
+    void copy_directory(TDirectory * from, TDirectory * to)
+    {
+        std::set<std::string> copied;
+        TIter next(from->GetListOfKeys());
+        TKey * key;
+        while((key = (TKey *) next()))
+        {
+            if(!copied.insert(key->GetName()).second)
+                continue;
+            TObject * object = key->ReadObj();
+            if(TDirectory * subdir = dynamic_cast<TDirectory *>(object))
+                copy_directory(subdir, to->mkdir(key->GetName()));
+            else if(TTree * tree = dynamic_cast<TTree *>(object))
+            {
+                to->cd();
+                TTree * clone = tree->CloneTree(-1, "fast");
+                to->WriteObject(clone, key->GetName());
+                delete clone;
+                delete tree;
+            }
+            else
+            {
+                to->WriteTObject(object, key->GetName());
+                delete object;
+            }
+        }
+    }
+}
+#endif // CACHE_H
@@ -0,0 +1,194 @@
+/**
+ * @file columnar.h
+ * @brief Header file for the columnar export of the Trees produced by the
+ * Analysis class.
+ * @details The Trees of the Analysis class are written as TTrees, which must
+ * be read in full (and decompressed) by uproot every time spineplot makes a
+ * plot. This file provides an optional columnar export of the same TTrees:
+ * each branch is written as a separate NumPy (.npy) file, which can be
+ * memory-mapped by spineplot (np.load(..., mmap_mode='r')) so that only the
+ * columns used by a plot are ever read. The layout of the export is
+ * "<analysis>.columns/<sample>/<tree>/<branch>.npy", next to the ROOT output.
+ * @note The .npy format was chosen over Arrow/Parquet because it needs no
+ * dependency beyond ROOT on the C++ side and is natively memory-mappable by
+ * NumPy on the Python side. The data is written in little-endian order.
+ * The export of each sample is tied to the ROOT output by a stamp (see
+ * @ref make_column_stamp()) stored both in the export and in the sample
+ * directory of the ROOT output, so that a stale export is never read.
+ * @author mueller@fnal.gov
+ */
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <filesystem>
+
+#include "TTree.h"
+#include "TBranch.h"
+#include "TLeaf.h"
+#include "TObjArray.h"
+#include "TSystem.h"
+
+namespace ana
+{
+    /**
+     * @brief Create a new stamp tying a columnar export to its ROOT output.
+     * @details The stamp is unique to a single write of a sample: the time
+     * of the write and a random number, in hexadecimal.
+     * @return The stamp.
+     */
+    std::string make_column_stamp()
+    {
+        std::ostringstream stamp;
+        stamp << std::hex << std::chrono::system_clock::now().time_since_epoch().count() << "-" << std::random_device()();
+        return stamp.str();
+    }
+
+    /**
+     * @brief Read the stamp of the columnar export of a sample.
+     * @param path The directory of the export of the sample.
+     * @return The stamp (empty if the export has none).
+     */
+    std::string read_column_stamp(const std::string & path)
+    {
+        std::ifstream file(path + "/stamp");
+        std::string stamp;
+        std::getline(file, stamp);
+        return stamp;
+    }
+
+    /**
+     * @brief Write the stamp of the columnar export of a sample.
+     * @details The stamp is written once all Trees of the sample have been
+     * exported, so an interrupted export never carries a valid stamp.
+     * @param path The directory of the export of the sample.
+     * @param stamp The stamp.
+     * @return void
+     */
+    void write_column_stamp(const std::string & path, const std::string & stamp)
+    {
+        gSystem->mkdir(path.c_str(), true);
+        std::ofstream file(path + "/stamp");
+        file << stamp << std::endl;
+    }
+
+    /**
+     * @brief Remove the columnar export of a sample.
+     * @details The export is removed before a sample is rewritten, so that
+     * the columns of removed branches or Trees do not linger in the export.
+     * @param path The directory of the export of the sample.
+     * @return void
+     */
+    void remove_columns(const std::string & path)
+    {
+        std::error_code error;
+        std::filesystem::remove_all(path, error);
+        if(error)
+            std::cerr << "Warning: Failed to remove the columnar export " << path << " (" << error.message() << ")." << std::endl;
+    }
+
+    /**
+     * @brief Write the header of a one-dimensional NumPy (.npy) array.
+     * @details The header follows version 1.0 of the format: the magic
+     * string, the version, the length of the header dictionary, and the
+     * dictionary itself padded with spaces (and a terminating newline) so
+     * that the data starts at a multiple of 64 bytes.
+     * @param file The output stream of the .npy file.
+     * @param descr The NumPy type descriptor of the array (e.g. "<f8").
+     * @param n The number of elements of the array.
+     * @return void
+     */
+    void write_npy_header(std::ofstream & file, const std::string & descr, size_t n)
+    {
+        std::string header("{'descr': '" + descr + "', 'fortran_order': False, 'shape': (" + std::to_string(n) + ",), }");
+        size_t total(10 + header.size() + 1);
+        header.append((64 - total % 64) % 64, ' ');
+        header.push_back('\n');
+        uint16_t length(header.size());
+        file.write("\x93NUMPY\x01\x00", 8);
+        file.write(reinterpret_cast<const char *>(&length), 2);
+        file.write(header.data(), header.size());
+    }
+
+    /**
+     * @brief Write a single (scalar) branch of a TTree as a .npy file.
+     * @details Only the requested branch is read, so the baskets of each
+     * branch are decompressed once. The values are read through the leaf of
+     * the branch and converted to the output type.
+     * @tparam T The type of the values in the output file.
+     * @param path The path of the .npy file.
+     * @param descr The NumPy type descriptor of T.
+     * @param branch The branch to write.
+     * @param leaf The (only) leaf of the branch.
+     * @param n The number of entries of the TTree.
+     * @return void
+     */
+    template<class T>
+        void write_npy_column(const std::string & path, const std::string & descr, TBranch * branch, TLeaf * leaf, Long64_t n)
+        {
+            std::vector<T> values(n);
+            for(Long64_t i(0); i < n; ++i)
+            {
+                branch->GetEntry(i);
+                values[i] = static_cast<T>(leaf->GetValue(0));
+            }
+            std::ofstream file(path, std::ios::binary);
+            write_npy_header(file, descr, n);
+            file.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+        }
+
+    /**
+     * @brief Write all (scalar) branches of a TTree as .npy files.
+     * @details Each branch is written to "<path>/<branch>.npy". Integer
+     * branches (e.g. Run, Subrun, Evt) keep an integer type so that they may
+     * still be used to identify events. Double branches are written as
+     * float64, or as float32 if the compact option is requested, which halves
+     * the size of the export at the cost of precision that is irrelevant for
+     * plotting. Branches with more than one value per entry are skipped.
+     * @param tree The TTree to export.
+     * @param path The directory of the export (created if needed).
+     * @param compact Whether to write double branches as float32.
+     * @return void
+     */
+    void write_columns(TTree * tree, const std::string & path, bool compact)
+    {
+        gSystem->mkdir(path.c_str(), true);
+        Long64_t n(tree->GetEntries());
+        TObjArray * branches = tree->GetListOfBranches();
+        for(int b(0); b < branches->GetEntries(); ++b)
+        {
+            TBranch * branch = (TBranch *) branches->At(b);
+            TLeaf * leaf = (TLeaf *) branch->GetListOfLeaves()->At(0);
+            if(!leaf || branch->GetListOfLeaves()->GetEntries() != 1 || leaf->GetLenStatic() != 1 || leaf->GetLeafCount())
+            {
+                std::cerr << "Warning: Skipping non-scalar branch " << branch->GetName() << " of TTree " << tree->GetName() << "." << std::endl;
+                continue;
+            }
+            std::string type(leaf->GetTypeName());
+            std::string file(path + "/" + branch->GetName() + ".npy");
+            if(type == "Int_t")
+                write_npy_column<int32_t>(file, "<i4", branch, leaf, n);
+            else if(type == "UInt_t")
+                write_npy_column<uint32_t>(file, "<u4", branch, leaf, n);
+            else if(type == "Long64_t")
+                write_npy_column<int64_t>(file, "<i8", branch, leaf, n);
+            else if(type == "ULong64_t")
+                write_npy_column<uint64_t>(file, "<u8", branch, leaf, n);
+            else if(type == "Char_t")
+                write_npy_column<int8_t>(file, "|i1", branch, leaf, n);
+            else if(type == "Bool_t")
+                write_npy_column<uint8_t>(file, "|b1", branch, leaf, n);
+            else if(type == "Float_t" || compact)
+                write_npy_column<float>(file, "<f4", branch, leaf, n);
+            else
+                write_npy_column<double>(file, "<f8", branch, leaf, n);
+        }
+    }
+}
+#endif // COLUMNAR_H
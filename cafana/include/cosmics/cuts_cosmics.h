@@ -35,7 +35,7 @@ namespace cuts::cosmics
     template<class T>
         bool single_cosmic_muon_cut(const T & obj)
         {
-            std::vector<uint32_t> c(utilities::count_primaries(obj));
+            const std::array<uint32_t, 5> & c(utilities::summarize(obj).counts);
             return obj.nu_id < 0 && c[0] == 0 && c[1] == 0 && c[2] == 1 && c[3] == 0 && c[4] == 0;
         }
 }
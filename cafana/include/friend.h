@@ -0,0 +1,128 @@
+/**
+ * @file friend.h
+ * @brief Header file for the alignment of friend trees used by the Analysis
+ * class to append new columns to an existing output file.
+ * @details A friend tree holds the columns of a Tree that are missing from
+ * the Tree of an existing output file. The new columns are computed by a
+ * fresh pass over the sample, and then re-ordered to match the entries of
+ * the existing Tree, so that a reader can attach the friend tree
+ * entry-by-entry with TTree::AddFriend() (the friend tree is written next to
+ * the existing Tree, but not attached to it in the file). The entries are matched by their key (Run, Subrun,
+ * Evt, nu_id, occurrence), where the occurrence disambiguates entries with
+ * identical identifiers (e.g. multiple candidates in the same event without a
+ * matched neutrino). Matching by key rather than by position keeps the
+ * friend aligned even if the order of the files (or of the events) processed
+ * by the SpectrumLoader changes between the two passes.
+ * @author mueller@fnal.gov
+ */
+#ifndef FRIEND_H
+#define FRIEND_H
+#include <vector>
+#include <string>
+#include <map>
+#include <tuple>
+#include <limits>
+#include <iostream>
+
+#include "TTree.h"
+#include "TLeaf.h"
+#include "TDirectory.h"
+
+namespace ana
+{
+    /**
+     * @brief Type definition for the key identifying an entry of a Tree.
+     * @details The key is (Run, Subrun, Evt, nu_id, occurrence).
+     */
+    typedef std::tuple<long long, long long, long long, long long, long long> entry_key_t;
+
+    /**
+     * @brief Read the keys of all entries of a Tree.
+     * @details The identifiers are read through the leaves of the branches,
+     * so the function does not depend on their types. If the Tree has no
+     * "nu_id" branch, the neutrino id of all entries is set to zero.
+     * @param tree The Tree to read the keys from.
+     * @return The key of each entry of the Tree.
+     */
+    std::vector<entry_key_t> read_entry_keys(TTree * tree)
+    {
+        const char * names[4] = {"Run", "Subrun", "Evt", "nu_id"};
+        TLeaf * leaves[4];
+        for(size_t k(0); k < 4; ++k)
+            leaves[k] = tree->GetLeaf(names[k]);
+
+        std::map<std::tuple<long long, long long, long long, long long>, long long> occurrences;
+        std::vector<entry_key_t> keys(tree->GetEntries());
+        for(Long64_t i(0); i < tree->GetEntries(); ++i)
+        {
+            long long values[4] = {0, 0, 0, 0};
+            for(size_t k(0); k < 4; ++k)
+            {
+                if(!leaves[k])
+                    continue;
+                leaves[k]->GetBranch()->GetEntry(i);
+                values[k] = (long long) leaves[k]->GetValue(0);
+            }
+            long long & n(occurrences[std::make_tuple(values[0], values[1], values[2], values[3])]);
+            keys[i] = entry_key_t(values[0], values[1], values[2], values[3], n++);
+        }
+        return keys;
+    }
+
+    /**
+     * @brief Write the friend tree aligned to the entries of an existing Tree.
+     * @details The entries of the computed Tree are matched to the entries of
+     * the existing Tree by key (see @ref read_entry_keys()), and the
+     * requested columns are written in the order of the existing Tree.
+     * Entries of the existing Tree without a match are filled with NaN, and
+     * the number of unmatched entries (on either side) is reported. The
+     * friend tree replaces any previous friend tree of the same name, so the
+     * directory holds a single cycle of it.
+     * @param existing The Tree of the existing output file.
+     * @param computed The Tree with the new columns and the identifiers.
+     * @param columns The names of the (double) columns of the friend tree.
+     * @param dir The directory to write the friend tree to.
+     * @param name The name of the friend tree.
+     * @return void
+     */
+    void write_friend_tree(TTree * existing, TTree * computed, const std::vector<std::string> & columns, TDirectory * dir, const std::string & name)
+    {
+        std::vector<entry_key_t> reference(read_entry_keys(existing));
+        std::vector<entry_key_t> keys(read_entry_keys(computed));
+        std::map<entry_key_t, Long64_t> index;
+        for(size_t i(0); i < keys.size(); ++i)
+            index.emplace(keys[i], i);
+
+        std::vector<double> values(columns.size());
+        for(size_t c(0); c < columns.size(); ++c)
+            computed->SetBranchAddress(columns[c].c_str(), &values[c]);
+        dir->cd();
+        TTree * output = new TTree(name.c_str(), name.c_str());
+        for(size_t c(0); c < columns.size(); ++c)
+            output->Branch(columns[c].c_str(), &values[c]);
+
+        size_t missing(0);
+        for(const entry_key_t & key : reference)
+        {
+            std::map<entry_key_t, Long64_t>::iterator it(index.find(key));
+            if(it != index.end())
+            {
+                computed->GetEntry(it->second);
+                index.erase(it);
+            }
+            else
+            {
+                values.assign(columns.size(), std::numeric_limits<double>::quiet_NaN());
+                ++missing;
+            }
+            output->Fill();
+        }
+        if(missing > 0 || !index.empty())
+            std::cerr << "Warning: Friend tree " << name << " has " << missing << " unmatched entries of the existing tree and "
+                      << index.size() << " unmatched computed entries." << std::endl;
+        computed->ResetBranchAddresses();
+        output->Write(name.c_str(), TObject::kOverwrite);
+        delete output;
+    }
+}
+#endif // FRIEND_H
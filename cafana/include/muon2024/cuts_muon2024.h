@@ -41,7 +41,7 @@ namespace cuts::muon2024
     template<class T>
         bool topological_1mu1p_cut(const T & obj)
         {
-            std::vector<uint32_t> c(utilities::count_primaries(obj));
+            const std::array<uint32_t, 5> & c(utilities::summarize(obj).counts);
             return c[0] == 0 && c[1] == 0 && c[2] == 1 && c[3] == 0 && c[4] == 1;
         }
 
@@ -57,7 +57,7 @@ namespace cuts::muon2024
     template<class T>
         bool topological_1muNp_cut(const T & obj)
         {
-            std::vector<uint32_t> c(utilities::count_primaries(obj));
+            const std::array<uint32_t, 5> & c(utilities::summarize(obj).counts);
             return c[0] == 0 && c[1] == 0 && c[2] == 1 && c[3] == 0 && c[4] >= 1;
         }
     
@@ -73,7 +73,7 @@ namespace cuts::muon2024
     template<class T>
         bool topological_1muX_cut(const T & obj)
         {
-            std::vector<uint32_t> c(utilities::count_primaries(obj));
+            const std::array<uint32_t, 5> & c(utilities::summarize(obj).counts);
             return c[2] == 1;
         }
 
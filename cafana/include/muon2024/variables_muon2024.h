@@ -77,12 +77,9 @@ namespace vars::muon2024
     template<class T>
         double opening_angle(const T & obj)
         {
-            auto & m(obj.particles[utilities::leading_particle_index(obj, 2)]);
-            auto & p(obj.particles[utilities::leading_particle_index(obj, 4)]);
-            if constexpr (std::is_same_v<T, caf::SRInteractionTruthDLPProxy>)
-                return std::acos(m.truth_start_dir[0] * p.truth_start_dir[0] + m.truth_start_dir[1] * p.truth_start_dir[1] + m.truth_start_dir[2] * p.truth_start_dir[2]);
-            else
-                return std::acos(m.start_dir[0] * p.start_dir[0] + m.start_dir[1] * p.start_dir[1] + m.start_dir[2] * p.start_dir[2]);
+            const utilities::Summary & s(utilities::summarize(obj));
+            size_t m(s.leading[2]), p(s.leading[4]);
+            return std::acos(s.start_dir[0][m] * s.start_dir[0][p] + s.start_dir[1][m] * s.start_dir[1][p] + s.start_dir[2][m] * s.start_dir[2][p]);
         }
 }
 #endif // VARS_MUON2024_H
\ No newline at end of file
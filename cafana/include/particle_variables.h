@@ -112,6 +112,24 @@ namespace pvars
                 return std::sqrt(std::pow(p.momentum[0], 2) + std::pow(p.momentum[1], 2));
         }
 
+    /**
+     * @brief Variable for the transverse momentum of a particle of a
+     * summarized interaction.
+     * @details This is the same variable as @ref transverse_momentum(const T &),
+     * evaluated on the momentum snapshot of the Summary of the interaction
+     * (see utilities::Summary), which holds the truth momentum for true
+     * interactions.
+     * @tparam S the type of the Summary.
+     * @param s the Summary of the interaction of the particle.
+     * @param i the index of the particle within the interaction.
+     * @return the transverse momentum of the particle.
+     */
+    template<class S>
+        double transverse_momentum(const S & s, size_t i)
+        {
+            return std::sqrt(std::pow(s.momentum[0][i], 2) + std::pow(s.momentum[1][i], 2));
+        }
+
     /**
      * @brief Variable for the polar angle (w.r.t the z-axis) of the particle.
      * @details The polar angle is defined as the arccosine of the z-component
@@ -130,6 +148,23 @@ namespace pvars
                 return std::acos(p.start_dir[2]);
         }
 
+    /**
+     * @brief Variable for the polar angle (w.r.t the z-axis) of a particle of
+     * a summarized interaction.
+     * @details This is the same variable as @ref polar_angle(const T &),
+     * evaluated on the start direction snapshot of the Summary of the
+     * interaction (see utilities::Summary).
+     * @tparam S the type of the Summary.
+     * @param s the Summary of the interaction of the particle.
+     * @param i the index of the particle within the interaction.
+     * @return the polar angle of the particle.
+     */
+    template<class S>
+        double polar_angle(const S & s, size_t i)
+        {
+            return std::acos(s.start_dir[2][i]);
+        }
+
     /**
      * @brief Variable for the azimuthal angle (w.r.t the z-axis) of the particle.
      * @details The azimuthal angle is defined as the arccosine of the x-component
@@ -147,5 +182,22 @@ namespace pvars
             else
                 return std::acos(p.start_dir[0] / std::sqrt(std::pow(p.start_dir[0], 2) + std::pow(p.start_dir[1], 2)));
         }
+
+    /**
+     * @brief Variable for the azimuthal angle (w.r.t the z-axis) of a
+     * particle of a summarized interaction.
+     * @details This is the same variable as @ref azimuthal_angle(const T &),
+     * evaluated on the start direction snapshot of the Summary of the
+     * interaction (see utilities::Summary).
+     * @tparam S the type of the Summary.
+     * @param s the Summary of the interaction of the particle.
+     * @param i the index of the particle within the interaction.
+     * @return the azimuthal angle of the particle.
+     */
+    template<class S>
+        double azimuthal_angle(const S & s, size_t i)
+        {
+            return std::acos(s.start_dir[0][i] / std::sqrt(std::pow(s.start_dir[0][i], 2) + std::pow(s.start_dir[1][i], 2)));
+        }
 }
 #endif // PARTICLE_VARIABLES_H
\ No newline at end of file
@@ -0,0 +1,204 @@
+/**
+ * @file prefetch.h
+ * @brief Header file for the read-ahead of the input files of a sample while
+ * the sample is processed by the Analysis class.
+ * @details The input files of the samples are typically read over the
+ * network (e.g. from /pnfs), so the processing of each file starts with the
+ * latency of opening it and of reading its first baskets. A Prefetcher warms
+ * the next input files of a sample on a background thread while the current
+ * file is processed: each file is opened and (up to a configurable number of
+ * bytes) read sequentially, which stages it in the storage and page caches
+ * so that the SpectrumLoader finds it warm. The SpectrumLoader does not
+ * report which file it is processing, so the progress of the sample is
+ * derived from the number of spills processed (see @ref Prefetcher::Track())
+ * and the number of entries of each warmed file. A mismatch of the order of
+ * the files (or a miscounted spill) only reduces the effect of the read-
+ * ahead, never the result of the analysis.
+ * @author mueller@fnal.gov
+ */
+#ifndef PREFETCH_H
+#define PREFETCH_H
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+#include "sbnana/CAFAna/Core/MultiVar.h"
+#include "sbnanaobj/StandardRecord/Proxy/SRProxy.h"
+
+#include "TFile.h"
+#include "TTree.h"
+
+namespace ana
+{
+    /**
+     * @class Prefetcher
+     * @brief Class warming the next input files of a sample on a background
+     * thread.
+     * @details The files are warmed in order, and at most depth files ahead
+     * of the file being processed are warmed. The thread is started by the
+     * constructor and stopped (and joined) by @ref Stop() or the destructor.
+     * Failures to open or read a file are reported as warnings and skipped,
+     * since the SpectrumLoader reports them itself.
+     */
+    class Prefetcher
+    {
+        public:
+            Prefetcher(const std::vector<std::string> & files, size_t depth, long long cache_size);
+            ~Prefetcher();
+            ana::SpillMultiVar Track(const ana::SpillMultiVar & var);
+            void Stop();
+            long long BytesRead() const;
+        private:
+            void Run();
+            bool Warm(const std::string & path, uint64_t & entries);
+            std::vector<std::string> files;
+            size_t depth;
+            long long cache_size;
+            std::vector<uint64_t> boundaries;
+            std::atomic<uint64_t> spills;
+            std::atomic<uint64_t> boundary;
+            std::atomic<bool> stop;
+            std::atomic<long long> bytes;
+            std::mutex mutex;
+            std::condition_variable wake;
+            std::thread thread;
+    };
+
+    /**
+     * @brief Constructor for the Prefetcher class.
+     * @param files The input files of the sample, in the order they are
+     * processed (see @ref expand_source()).
+     * @param depth The number of files to warm ahead of the file being
+     * processed.
+     * @param cache_size The number of bytes to read from each file (the
+     * whole file if not positive).
+     * @return A new instance of the Prefetcher class.
+     */
+    Prefetcher::Prefetcher(const std::vector<std::string> & files, size_t depth, long long cache_size)
+        : files(files), depth(depth), cache_size(cache_size), spills(0), boundary(0), stop(false), bytes(0)
+    {
+        thread = std::thread(&Prefetcher::Run, this);
+    }
+
+    /**
+     * @brief Destructor for the Prefetcher class.
+     */
+    Prefetcher::~Prefetcher()
+    {
+        Stop();
+    }
+
+    /**
+     * @brief Stop the read-ahead and join the background thread.
+     * @details The current read of the thread is completed, but no further
+     * reads are started.
+     * @return void
+     */
+    void Prefetcher::Stop()
+    {
+        stop = true;
+        wake.notify_one();
+        if(thread.joinable())
+            thread.join();
+    }
+
+    /**
+     * @brief Wrap a column of the sample to track its progress.
+     * @details Like @ref count_spills(), the column must be called exactly
+     * once per spill. The background thread is only woken when the spill
+     * count reaches the end of the file it is waiting for.
+     * @param var The column to wrap.
+     * @return The wrapped column.
+     */
+    ana::SpillMultiVar Prefetcher::Track(const ana::SpillMultiVar & var)
+    {
+        ana::SpillMultiVar v(var);
+        return ana::SpillMultiVar([this, v](const caf::SRSpillProxy * sr)
+        {
+            if(++spills == boundary)
+                wake.notify_one();
+            return v(sr);
+        });
+    }
+
+    /**
+     * @brief Get the number of bytes read by the read-ahead.
+     * @return The number of bytes read so far.
+     */
+    long long Prefetcher::BytesRead() const
+    {
+        return bytes;
+    }
+
+    /**
+     * @brief Warm the input files in order.
+     * @details File i is warmed once the spills of file i - depth - 1 have
+     * all been processed. The end of each file (in spills) is the number of
+     * entries of its "recTree", summed over the preceding files. The wait is
+     * bounded so that a missed wake-up only delays the read-ahead.
+     * @return void
+     */
+    void Prefetcher::Run()
+    {
+        uint64_t total(0);
+        for(size_t i(0); i < files.size() && !stop; ++i)
+        {
+            if(i > depth)
+            {
+                boundary = boundaries[i - depth - 1];
+                std::unique_lock<std::mutex> lock(mutex);
+                while(!stop && spills < boundary)
+                    wake.wait_for(lock, std::chrono::milliseconds(100));
+            }
+            if(stop)
+                break;
+            uint64_t entries(0);
+            if(!Warm(files[i], entries))
+                std::cerr << "Warning: Failed to prefetch input file " << files[i] << "." << std::endl;
+            total += entries;
+            boundaries.push_back(total);
+        }
+    }
+
+    /**
+     * @brief Warm a single input file.
+     * @details The file is opened, the number of entries of its "recTree" is
+     * read, and the file is read sequentially in blocks of 4 MB up to the
+     * cache size of the Prefetcher.
+     * @param path The path of the input file.
+     * @param entries The number of entries of the "recTree" (output).
+     * @return True if the file was opened and read.
+     */
+    bool Prefetcher::Warm(const std::string & path, uint64_t & entries)
+    {
+        TFile * f = TFile::Open(path.c_str(), "READ");
+        if(!f || f->IsZombie())
+        {
+            delete f;
+            return false;
+        }
+        TTree * tree = f->Get<TTree>("recTree");
+        entries = tree ? tree->GetEntries() : 0;
+        long long size(cache_size > 0 ? std::min(cache_size, f->GetSize()) : f->GetSize());
+        std::vector<char> buffer(4 << 20);
+        bool ok(true);
+        for(long long offset(0); offset < size && ok && !stop; offset += buffer.size())
+        {
+            int length(std::min<long long>(buffer.size(), size - offset));
+            ok = !f->ReadBuffer(buffer.data(), offset, length);
+            if(ok)
+                bytes += length;
+        }
+        f->Close();
+        delete f;
+        return ok;
+    }
+}
+#endif // PREFETCH_H
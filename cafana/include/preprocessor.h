@@ -2,11 +2,29 @@
  * @file preprocessor.h
  * @brief Header file for preprocessor macros that streamline variable
  * declarations.
+ * @details The SPINEVAR macros fill a reusable (thread-local) buffer owned by
+ * each declared variable in place, so the spill loop does not repeatedly grow
+ * a fresh vector. The filled buffer is moved into the result of the
+ * SpillMultiVar (see utilities::release_buffer()) rather than copied, so each
+ * spill with at least one entry costs a single, exactly-sized allocation.
+ * Spills without entries do not allocate at all. The spill is
+ * taken as a generic parameter, so the same loops may also be run on the
+ * synthetic spills of the benchmarks (see bench/synthetic.h). The matches
+ * between the reco and true interactions and the truth category of each true
+ * interaction are looked up in the MatchTable of the spill (see
+ * utilities::match_table()), which is shared by all columns, and reco
+ * interactions without a match yield utilities::kUnmatched for variables of
+ * the matched true interaction.
  * @author mueller@fnal.gov
 */
 #ifndef PREPROCESSOR_H
 #define PREPROCESSOR_H
 #include "sbnana/CAFAna/Core/MultiVar.h"
+#include "include/selection.h"
+#include "include/registry.h"
+#include "include/utilities.h"
+
+#include <type_traits>
 
 /**
  * @brief Preprocessor wrapper for looping over reco interactions and
@@ -23,17 +41,21 @@
  * passing the cut SEL and which belongs to the truth category established by
  * CAT.
  */
-#define SPINEVAR_RR(VAR,SEL,CAT)                                                            \
-    [](const caf::SRSpillProxy* sr)                                                         \
-    {                                                                                       \
-        std::vector<double> var;                                                            \
-        bool is_mc(sr->ndlp_true != 0);                                                     \
-        for(auto const& i : sr->dlp)                                                        \
-        {                                                                                   \
-            if(SEL(i) && ((i.match.size() > 0 && CAT(sr->dlp_true[i.match[0]])) || !is_mc)) \
-                var.push_back(VAR(i));                                                      \
-        }                                                                                   \
-        return var;                                                                         \
+#define SPINEVAR_RR(VAR,SEL,CAT)                                                                            \
+    [](const auto * sr)                                                                                     \
+    {                                                                                                       \
+        thread_local std::vector<double> var;                                                               \
+        var.clear();                                                                                        \
+        const utilities::MatchTable & m(utilities::match_table(sr));                                        \
+        bool is_mc(sr->ndlp_true != 0);                                                                     \
+        for(size_t k(0); k < sr->dlp.size(); ++k)                                                           \
+        {                                                                                                   \
+            int64_t t(m.reco_to_true[k]);                                                                   \
+            if(SEL(sr->dlp[k]) && (!is_mc                                                                   \
+                || utilities::in_category<std::decay_t<decltype(sr->dlp_true[0])>>(sr, t, CAT)))            \
+                var.push_back(VAR(sr->dlp[k]));                                                             \
+        }                                                                                                   \
+        return utilities::release_buffer(var);                                                              \
     }
 
  /**
@@ -51,18 +73,22 @@
  * is matched to by a reco interaction passing the cut SEL and which belongs to
  * the truth category established by CAT.
  */
-#define SPINEVAR_RT(VAR,SEL,CAT)                                                            \
-    [](const caf::SRSpillProxy* sr)                                                         \
-    {                                                                                       \
-        std::vector<double> var;                                                            \
-        bool is_mc(sr->ndlp_true != 0);                                                     \
-        for(auto const& i : sr->dlp)                                                        \
-        {                                                                                   \
-            if(SEL(i) && ((i.match.size() > 0 && CAT(sr->dlp_true[i.match[0]])) || !is_mc)) \
-                var.push_back(i.match.size() > 0 ? VAR(sr->dlp_true[i.match[0]]) : -1.0);   \
-        }                                                                                   \
-        return var;                                                                         \
- }
+#define SPINEVAR_RT(VAR,SEL,CAT)                                                                            \
+    [](const auto * sr)                                                                                     \
+    {                                                                                                       \
+        thread_local std::vector<double> var;                                                               \
+        var.clear();                                                                                        \
+        const utilities::MatchTable & m(utilities::match_table(sr));                                        \
+        bool is_mc(sr->ndlp_true != 0);                                                                     \
+        for(size_t k(0); k < sr->dlp.size(); ++k)                                                           \
+        {                                                                                                   \
+            int64_t t(m.reco_to_true[k]);                                                                   \
+            if(SEL(sr->dlp[k]) && (!is_mc                                                                   \
+                || utilities::in_category<std::decay_t<decltype(sr->dlp_true[0])>>(sr, t, CAT)))            \
+                var.push_back(t >= 0 ? VAR(sr->dlp_true[t]) : utilities::kUnmatched);                       \
+        }                                                                                                   \
+        return utilities::release_buffer(var);                                                              \
+    }
 
 /**
  * @brief Preprocessor wrapper for looping over true interactions and
@@ -75,16 +101,18 @@
  * @return a vector with the result of VAR called on each reco interaction that
  * is matched to by a true interaction passing the cut SEL.
  */
-#define SPINEVAR_TR(VAR,SEL)                         \
-    [](const caf::SRSpillProxy* sr)                  \
-    {							                     \
-        std::vector<double> var;			         \
-        for(auto const& i : sr->dlp_true)	         \
-        {                                            \
-            if(SEL(i) && i.match.size() > 0)         \
-            var.push_back(VAR(sr->dlp[i.match[0]])); \
-        }                                            \
-        return var;                                  \
+#define SPINEVAR_TR(VAR,SEL)                                         \
+    [](const auto * sr)                                              \
+    {                                                                \
+        thread_local std::vector<double> var;                        \
+        var.clear();                                                 \
+        const utilities::MatchTable & m(utilities::match_table(sr)); \
+        for(size_t k(0); k < sr->dlp_true.size(); ++k)               \
+        {                                                            \
+            if(SEL(sr->dlp_true[k]) && m.true_to_reco[k] >= 0)       \
+                var.push_back(VAR(sr->dlp[m.true_to_reco[k]]));      \
+        }                                                            \
+        return utilities::release_buffer(var);                       \
     }
 
 /**
@@ -98,15 +126,79 @@
  * @return a vector with the result of VAR called on each true interaction
  * passing the cut SEL.
  */
-#define SPINEVAR_TT(VAR,SEL)                 \
-    [](const caf::SRSpillProxy* sr)          \
-    {                                        \
-        std::vector<double> var;             \
-        for(auto const& i : sr->dlp_true)    \
-        {                                    \
-            if(SEL(i) && i.match.size() > 0) \
-                var.push_back(VAR(i));       \
-        }                                    \
-        return var;                          \
+#define SPINEVAR_TT(VAR,SEL)                                         \
+    [](const auto * sr)                                              \
+    {                                                                \
+        thread_local std::vector<double> var;                        \
+        var.clear();                                                 \
+        const utilities::MatchTable & m(utilities::match_table(sr)); \
+        for(size_t k(0); k < sr->dlp_true.size(); ++k)               \
+        {                                                            \
+            if(SEL(sr->dlp_true[k]) && m.true_to_reco[k] >= 0)       \
+                var.push_back(VAR(sr->dlp_true[k]));                 \
+        }                                                            \
+        return utilities::release_buffer(var);                       \
+    }
+
+/**
+ * @brief Preprocessor wrapper for declaring a reco interaction cut type for use
+ * with the fused (compile-time) trees of the Analysis class.
+ * @details This macro declares a struct named TYPE with a static function that
+ * applies the cut to a reco interaction. The struct may be declared locally
+ * within the analysis macro.
+ * @param TYPE the name of the declared type.
+ * @param SEL function to select interactions.
+ */
+#define SPINECUT_RECO(TYPE,SEL)                                                     \
+    struct TYPE                                                                     \
+    {                                                                               \
+        static bool eval(const caf::SRInteractionDLPProxy & i) { return SEL(i); }   \
+    }
+
+/**
+ * @brief Preprocessor wrapper for declaring a true interaction cut type for use
+ * with the fused (compile-time) trees of the Analysis class.
+ * @details This macro declares a struct named TYPE with a static function that
+ * applies the cut to a true interaction. The struct may be declared locally
+ * within the analysis macro.
+ * @param TYPE the name of the declared type.
+ * @param SEL function to select interactions.
+ */
+#define SPINECUT_TRUE(TYPE,SEL)                                                         \
+    struct TYPE                                                                         \
+    {                                                                                   \
+        static bool eval(const caf::SRInteractionTruthDLPProxy & i) { return SEL(i); }  \
+    }
+
+/**
+ * @brief Preprocessor wrapper for declaring a column type of a fused tree that
+ * is evaluated on the reco interaction of each candidate.
+ * @details This macro declares a struct named NAME that implements the column.
+ * The name of the type is also used as the name of the column (branch) in the
+ * output TTree.
+ * @param NAME the name of the column.
+ * @param VAR function to broadcast over the selected reco interactions.
+ */
+#define SPINECOLUMN_R(NAME,VAR)                                                         \
+    struct NAME : ana::RecoColumn                                                       \
+    {                                                                                   \
+        static const char * name() { return #NAME; }                                    \
+        static double eval(const caf::SRInteractionDLPProxy & i) { return VAR(i); }     \
+    }
+
+/**
+ * @brief Preprocessor wrapper for declaring a column type of a fused tree that
+ * is evaluated on the true interaction of each candidate.
+ * @details This macro declares a struct named NAME that implements the column.
+ * The name of the type is also used as the name of the column (branch) in the
+ * output TTree.
+ * @param NAME the name of the column.
+ * @param VAR function to broadcast over the selected true interactions.
+ */
+#define SPINECOLUMN_T(NAME,VAR)                                                         \
+    struct NAME : ana::TrueColumn                                                       \
+    {                                                                                   \
+        static const char * name() { return #NAME; }                                    \
+        static double eval(const caf::SRInteractionTruthDLPProxy & i) { return VAR(i); }\
     }
 #endif // PREPROCESSOR_H
\ No newline at end of file
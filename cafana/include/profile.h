@@ -0,0 +1,269 @@
+/**
+ * @file profile.h
+ * @brief Header file for the profiling instrumentation of the Analysis class.
+ * @details When profiling is enabled (see Analysis::SetProfiling()), each
+ * column of each Tree, the cuts of the selected Trees, and the spill-level
+ * preselection are wrapped with a low-overhead counter that records the
+ * number of calls, the number of interactions visited, the number of entries
+ * emitted (or, for cuts, the number of passes), and the cumulative time spent
+ * in the wrapped function. The counters of a sample are owned by a
+ * SampleProfile, which also records the wall time, the number of spills, and
+ * the number of bytes read by the sample. The profile is printed as a table
+ * and written to the "profile" directory of the output file.
+ * @author mueller@fnal.gov
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+#include <vector>
+#include <string>
+#include <deque>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+
+#include "sbnana/CAFAna/Core/MultiVar.h"
+#include "sbnanaobj/StandardRecord/Proxy/SRProxy.h"
+
+#include "TDirectory.h"
+#include "TTree.h"
+
+#include "include/selection.h"
+
+namespace ana
+{
+    /**
+     * @struct ProfileCounter
+     * @brief Struct to store the counters of a single profiled function.
+     * @details The kind is one of "column", "cut", "truth_cut", or
+     * "spill_cut". For columns, the interactions visited are the reco and
+     * true interactions of each spill for which the column is evaluated, and
+     * the entries are the values emitted by the column. For cuts, each call
+     * visits a single interaction and the entries are the passing calls.
+     */
+    struct ProfileCounter
+    {
+        std::string tree;
+        std::string name;
+        std::string kind;
+        uint64_t calls = 0;
+        uint64_t visited = 0;
+        uint64_t entries = 0;
+        uint64_t ns = 0;
+    };
+
+    /**
+     * @brief Type definition for the clock used by the profiling counters.
+     */
+    typedef std::chrono::steady_clock profile_clock_t;
+
+    /**
+     * @brief Get the elapsed time since a time point in nanoseconds.
+     * @param start The time point.
+     * @return The elapsed time (ns).
+     */
+    inline uint64_t elapsed_ns(profile_clock_t::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(profile_clock_t::now() - start).count();
+    }
+
+    /**
+     * @class SampleProfile
+     * @brief Class to store the profile of a single sample.
+     * @details The counters are stored in a deque so that references handed
+     * out to the wrapped functions remain valid as counters are added. A
+     * sample is processed by a single thread, so the counters are not
+     * synchronized. The bytes read are counted for the whole process, so
+     * they include the reads of the samples run concurrently if the shared
+     * flag is set.
+     */
+    class SampleProfile
+    {
+        public:
+            ProfileCounter & Add(const std::string & tree, const std::string & name, const std::string & kind);
+            void Print(const std::string & sample) const;
+            void Write(TDirectory * dir) const;
+            std::deque<ProfileCounter> counters;
+            double wall = 0;
+            uint64_t spills = 0;
+            long long bytes = 0;
+            bool shared_bytes = false;
+    };
+
+    /**
+     * @brief Add a new counter to the profile.
+     * @param tree The name of the Tree of the profiled function.
+     * @param name The name of the profiled function.
+     * @param kind The kind of the profiled function.
+     * @return A reference to the new counter.
+     */
+    ProfileCounter & SampleProfile::Add(const std::string & tree, const std::string & name, const std::string & kind)
+    {
+        counters.emplace_back();
+        counters.back().tree = tree;
+        counters.back().name = name;
+        counters.back().kind = kind;
+        return counters.back();
+    }
+
+    /**
+     * @brief Print the profile of the sample as a table.
+     * @details The counters are printed in the order they were booked,
+     * along with their share of the wall time of the sample.
+     * @param sample The name of the sample.
+     * @return void
+     */
+    void SampleProfile::Print(const std::string & sample) const
+    {
+        std::printf("Profile of sample %s: %.2f s, %llu spills (%.1f spills/s), %.1f MB read%s\n",
+                    sample.c_str(), wall, (unsigned long long) spills, wall > 0 ? spills / wall : 0.0, bytes / 1e6,
+                    shared_bytes ? " (process-wide, includes concurrent samples)" : "");
+        std::printf("  %-20s %-30s %-10s %12s %14s %12s %12s %7s\n", "tree", "name", "kind", "calls", "interactions", "entries", "ns/call", "share");
+        for(const ProfileCounter & c : counters)
+        {
+            std::printf("  %-20s %-30s %-10s %12llu %14llu %12llu %12.1f %6.1f%%\n",
+                        c.tree.c_str(), c.name.c_str(), c.kind.c_str(), (unsigned long long) c.calls,
+                        (unsigned long long) c.visited, (unsigned long long) c.entries,
+                        c.calls > 0 ? double(c.ns) / c.calls : 0.0, wall > 0 ? 100 * c.ns / (wall * 1e9) : 0.0);
+        }
+    }
+
+    /**
+     * @brief Write the profile of the sample to a directory.
+     * @details The counters are written to a TTree "counters" with one entry
+     * per counter, and the sample summary to a TTree "summary" with a single
+     * entry ("bytes_shared" flags process-wide bytes read). Existing
+     * profiles in the directory are replaced.
+     * @param dir The directory to write the profile to.
+     * @return void
+     */
+    void SampleProfile::Write(TDirectory * dir) const
+    {
+        dir->cd();
+        std::string tree, name, kind;
+        ULong64_t calls, visited, entries, ns;
+        TTree * c = new TTree("counters", "counters");
+        c->Branch("tree", &tree);
+        c->Branch("name", &name);
+        c->Branch("kind", &kind);
+        c->Branch("calls", &calls);
+        c->Branch("interactions", &visited);
+        c->Branch("entries", &entries);
+        c->Branch("ns", &ns);
+        for(const ProfileCounter & p : counters)
+        {
+            tree = p.tree;
+            name = p.name;
+            kind = p.kind;
+            calls = p.calls;
+            visited = p.visited;
+            entries = p.entries;
+            ns = p.ns;
+            c->Fill();
+        }
+        dir->WriteObject(c, "counters", "WriteDelete");
+        delete c;
+
+        double w(wall), rate(wall > 0 ? spills / wall : 0.0);
+        ULong64_t n(spills);
+        Long64_t b(bytes);
+        Bool_t shared(shared_bytes);
+        TTree * s = new TTree("summary", "summary");
+        s->Branch("wall", &w);
+        s->Branch("spills", &n);
+        s->Branch("spills_per_second", &rate);
+        s->Branch("bytes_read", &b);
+        s->Branch("bytes_shared", &shared);
+        s->Fill();
+        dir->WriteObject(s, "summary", "WriteDelete");
+        delete s;
+    }
+
+    /**
+     * @brief Wrap a column with a profiling counter.
+     * @param var The column to profile.
+     * @param counter The counter of the column.
+     * @return The profiled column.
+     */
+    ana::SpillMultiVar profile_var(const ana::SpillMultiVar & var, ProfileCounter & counter)
+    {
+        ana::SpillMultiVar v(var);
+        ProfileCounter * c(&counter);
+        return ana::SpillMultiVar([v, c](const caf::SRSpillProxy * sr)
+        {
+            profile_clock_t::time_point start(profile_clock_t::now());
+            std::vector<double> result(v(sr));
+            c->ns += elapsed_ns(start);
+            ++c->calls;
+            c->visited += sr->dlp.size() + sr->dlp_true.size();
+            c->entries += result.size();
+            return result;
+        });
+    }
+
+    /**
+     * @brief Wrap a cut acting on a single (reco or true) interaction with a
+     * profiling counter.
+     * @tparam T The type of the interaction.
+     * @param cut The cut to profile.
+     * @param counter The counter of the cut.
+     * @return The profiled cut.
+     */
+    template<class T>
+        std::function<bool(const T &)> profile_cut(const std::function<bool(const T &)> & cut, ProfileCounter & counter)
+        {
+            ProfileCounter * c(&counter);
+            return [cut, c](const T & obj)
+            {
+                profile_clock_t::time_point start(profile_clock_t::now());
+                bool pass(cut(obj));
+                c->ns += elapsed_ns(start);
+                ++c->calls;
+                ++c->visited;
+                c->entries += pass;
+                return pass;
+            };
+        }
+
+    /**
+     * @brief Wrap a spill-level preselection with a profiling counter.
+     * @param cut The preselection to profile.
+     * @param counter The counter of the preselection.
+     * @return The profiled preselection.
+     */
+    SpillPrecut profile_spill_cut(const SpillPrecut & cut, ProfileCounter & counter)
+    {
+        ProfileCounter * c(&counter);
+        return [cut, c](const caf::SRSpillProxy * sr)
+        {
+            profile_clock_t::time_point start(profile_clock_t::now());
+            bool pass(cut(sr));
+            c->ns += elapsed_ns(start);
+            ++c->calls;
+            c->visited += sr->dlp.size();
+            c->entries += pass;
+            return pass;
+        };
+    }
+
+    /**
+     * @brief Wrap a column to count the spills of a sample.
+     * @details The wrapper must be the outermost wrapper of a column that is
+     * called exactly once per spill.
+     * @param var The column to wrap.
+     * @param spills The spill counter of the sample.
+     * @return The wrapped column.
+     */
+    ana::SpillMultiVar count_spills(const ana::SpillMultiVar & var, uint64_t & spills)
+    {
+        ana::SpillMultiVar v(var);
+        uint64_t * n(&spills);
+        return ana::SpillMultiVar([v, n](const caf::SRSpillProxy * sr)
+        {
+            ++(*n);
+            return v(sr);
+        });
+    }
+}
+#endif // PROFILE_H
@@ -0,0 +1,272 @@
+/**
+ * @file registry.h
+ * @brief Header file for the compile-time registry of tree columns used by the
+ * Analysis class to build fused selected trees.
+ * @details The selected trees declared with @ref ana::SelectedVar store each
+ * column behind a type-erased std::function, so every column of every
+ * candidate costs an indirect call. This file provides a compile-time
+ * alternative: each cut and column is declared as a (local) type with a
+ * static evaluation function, and a tree is the type list of its columns.
+ * The full tree is then evaluated in a single loop over the interactions of
+ * the spill, with every cut and column call known to (and inlinable by) the
+ * compiler. The SpectrumLoader still calls one SpillMultiVar per column, but
+ * all but the first call of each spill simply return the pre-filled buffer.
+ * @author mueller@fnal.gov
+ */
+#ifndef REGISTRY_H
+#define REGISTRY_H
+#include <vector>
+#include <string>
+#include <array>
+#include <memory>
+#include <utility>
+#include <numeric>
+#include <algorithm>
+
+#include "sbnana/CAFAna/Core/MultiVar.h"
+#include "sbnanaobj/StandardRecord/Proxy/SRProxy.h"
+
+#include "include/utilities.h"
+#include "include/profile.h"
+
+namespace ana
+{
+    /**
+     * @brief Base classes tagging a column type as acting on the reco or the
+     * true interaction of each candidate.
+     */
+    struct RecoColumn { static constexpr bool truth = false; };
+    struct TrueColumn { static constexpr bool truth = true; };
+
+    /**
+     * @struct NoRecoCut
+     * @brief Placeholder reco cut type for truth-driven fused trees.
+     */
+    struct NoRecoCut { static bool eval(const caf::SRInteractionDLPProxy &) { return true; } };
+
+    /**
+     * @class FusedSelection
+     * @brief Class that evaluates a selection and all the columns of a tree in
+     * a single loop per spill.
+     * @details The selection semantics are identical to those of
+     * @ref SpillSelection (reco-driven or truth-driven), and the result of
+     * each column is stored in a per-column buffer that is reused across
+     * spills. The cache is invalidated whenever the index of the current
+     * spill changes, as described in @ref SpillSelection. If the selection
+     * is profiled, each evaluation of the cuts and of each column within the
+     * fused loop is timed with its own counter, so the time of the loop is
+     * split over the cuts and columns rather than charged to whichever
+     * column is called first in the spill.
+     * @tparam TruthDriven whether the tree loops over the true interactions.
+     * @tparam Cut the type implementing the cut on the reco interaction.
+     * @tparam TruthCut the type implementing the cut on the true interaction.
+     * @tparam Columns the types implementing the columns of the tree.
+     */
+    template<bool TruthDriven, class Cut, class TruthCut, class... Columns>
+        class FusedSelection
+        {
+            public:
+                FusedSelection() : spill(0) {}
+
+                /**
+                 * @brief Constructor for a (possibly) profiled selection.
+                 * @details The counters of the cuts and of the columns (in
+                 * alphabetical order of their names) are added to the
+                 * profile, which must outlive the selection.
+                 * @param profile The profile of the sample (nullptr if the
+                 * sample is not profiled).
+                 * @param tree The name of the Tree.
+                 */
+                FusedSelection(SampleProfile * profile, const std::string & tree) : FusedSelection()
+                {
+                    if(!profile)
+                        return;
+                    profiled = true;
+                    if constexpr (!TruthDriven)
+                        cut_counter = &profile->Add(tree, "cut", "cut");
+                    truth_counter = &profile->Add(tree, "truth_cut", "truth_cut");
+                    std::vector<std::string> names(Names());
+                    std::vector<size_t> order(names.size());
+                    std::iota(order.begin(), order.end(), 0);
+                    std::sort(order.begin(), order.end(), [&names](size_t a, size_t b) { return names[a] < names[b]; });
+                    for(size_t c : order)
+                        column_counters[c] = &profile->Add(tree, names[c], "column");
+                }
+
+                /**
+                 * @brief Retrieve the values of a column for the current spill.
+                 * @details The selection and all columns are evaluated on the
+                 * first call of any column in a new spill. If no spill is
+                 * active (see utilities::enter_spill()), they are evaluated
+                 * on each call.
+                 * @param sr The spill to retrieve the values for.
+                 * @param column The index of the requesting column.
+                 * @return The values of the column for the spill.
+                 */
+                std::vector<double> & Get(const caf::SRSpillProxy * sr, size_t column)
+                {
+                    uint64_t current(utilities::current_spill());
+                    if(current == 0 || current != spill)
+                    {
+                        if(profiled)
+                            Evaluate<true>(sr, std::index_sequence_for<Columns...>{});
+                        else
+                            Evaluate<false>(sr, std::index_sequence_for<Columns...>{});
+                        spill = current;
+                    }
+                    return buffers[column];
+                }
+
+                /**
+                 * @brief Retrieve the names of the columns.
+                 * @return A vector with the name of each column.
+                 */
+                static std::vector<std::string> Names() { return {Columns::name()...}; }
+
+            private:
+                /**
+                 * @brief Evaluate the selection and fill all columns.
+                 * @details If profiled, the truth cut of a reco-driven tree
+                 * is evaluated directly on each matched candidate instead of
+                 * through the memoized utilities::in_category(), so that its
+                 * counter records every call.
+                 * @tparam Profiled whether the cuts and columns are timed.
+                 * @param sr The spill to evaluate the selection on.
+                 * @return void
+                 */
+                template<bool Profiled, size_t... Is>
+                    void Evaluate(const caf::SRSpillProxy * sr, std::index_sequence<Is...>)
+                    {
+                        const utilities::MatchTable & m(utilities::match_table(sr));
+                        for(std::vector<double> & b : buffers)
+                            b.clear();
+                        if constexpr (TruthDriven)
+                        {
+                            for(size_t k(0); k < sr->dlp_true.size(); ++k)
+                            {
+                                auto const & t(sr->dlp_true[k]);
+                                if(Pass<TruthCut, Profiled>(t, truth_counter) && m.true_to_reco[k] >= 0)
+                                    (Fill<Columns, Profiled>(buffers[Is], &sr->dlp[m.true_to_reco[k]], &t, column_counters[Is]), ...);
+                            }
+                        }
+                        else
+                        {
+                            bool is_mc(sr->ndlp_true != 0);
+                            for(size_t k(0); k < sr->dlp.size(); ++k)
+                            {
+                                auto const & r(sr->dlp[k]);
+                                if(!Pass<Cut, Profiled>(r, cut_counter))
+                                    continue;
+                                int64_t t(m.reco_to_true[k]);
+                                bool category;
+                                if constexpr (Profiled)
+                                    category = !is_mc || (t >= 0 && Pass<TruthCut, true>(sr->dlp_true[t], truth_counter));
+                                else
+                                    category = !is_mc || utilities::in_category<caf::SRInteractionTruthDLPProxy>(sr, t, &TruthCut::eval);
+                                if(category)
+                                    (Fill<Columns, Profiled>(buffers[Is], &r, t >= 0 ? &sr->dlp_true[t] : nullptr, column_counters[Is]), ...);
+                            }
+                        }
+                        if constexpr (Profiled)
+                        {
+                            for(size_t c(0); c < buffers.size(); ++c)
+                            {
+                                ++column_counters[c]->calls;
+                                column_counters[c]->visited += sr->dlp.size() + sr->dlp_true.size();
+                                column_counters[c]->entries += buffers[c].size();
+                            }
+                        }
+                    }
+
+                /**
+                 * @brief Evaluate a cut on a single interaction.
+                 * @tparam C the type implementing the cut.
+                 * @tparam Profiled whether the call is timed.
+                 * @tparam T the type of the interaction.
+                 * @param obj The interaction to evaluate the cut on.
+                 * @param counter The counter of the cut (if profiled).
+                 * @return True if the interaction passes the cut.
+                 */
+                template<class C, bool Profiled, class T>
+                    static bool Pass(const T & obj, ProfileCounter * counter)
+                    {
+                        if constexpr (!Profiled)
+                            return C::eval(obj);
+                        else
+                        {
+                            profile_clock_t::time_point start(profile_clock_t::now());
+                            bool pass(C::eval(obj));
+                            counter->ns += elapsed_ns(start);
+                            ++counter->calls;
+                            ++counter->visited;
+                            counter->entries += pass;
+                            return pass;
+                        }
+                    }
+
+                /**
+                 * @brief Evaluate a single column on a candidate.
+                 * @details Columns acting on a missing interaction are filled
+                 * with utilities::kUnmatched (the same convention as
+                 * SPINEVAR_RT).
+                 * @tparam C the type implementing the column.
+                 * @tparam Profiled whether the call is timed.
+                 * @param b The buffer of the column.
+                 * @param r The reco interaction of the candidate (or nullptr).
+                 * @param t The true interaction of the candidate (or nullptr).
+                 * @param counter The counter of the column (if profiled).
+                 * @return void
+                 */
+                template<class C, bool Profiled>
+                    static void Fill(std::vector<double> & b, const caf::SRInteractionDLPProxy * r, const caf::SRInteractionTruthDLPProxy * t, ProfileCounter * counter)
+                    {
+                        profile_clock_t::time_point start;
+                        if constexpr (Profiled)
+                            start = profile_clock_t::now();
+                        if constexpr (C::truth)
+                            b.push_back(t ? C::eval(*t) : utilities::kUnmatched);
+                        else
+                            b.push_back(r ? C::eval(*r) : utilities::kUnmatched);
+                        if constexpr (Profiled)
+                            counter->ns += elapsed_ns(start);
+                    }
+
+                std::array<std::vector<double>, sizeof...(Columns)> buffers;
+                uint64_t spill;
+                bool profiled = false;
+                ProfileCounter * cut_counter = nullptr;
+                ProfileCounter * truth_counter = nullptr;
+                std::array<ProfileCounter *, sizeof...(Columns)> column_counters = {};
+        };
+
+    /**
+     * @brief Book the SpillMultiVars implementing the columns of a fused tree
+     * on a single loader.
+     * @details This function creates a fresh FusedSelection shared by all the
+     * columns, and one SpillMultiVar per column that returns the values of
+     * the column computed in the (single) fused loop of the spill. The
+     * buffer of the column is moved into the result (see
+     * utilities::release_buffer()), so each column must be called once per
+     * spill, as done by the CAFAna Tree. If a profile is given, the cuts and
+     * columns are profiled within the fused loop (see @ref FusedSelection).
+     * @tparam Selection the FusedSelection type of the tree.
+     * @param profile The profile of the sample (nullptr if not profiled).
+     * @param tree The name of the Tree (used to label the counters).
+     * @return A vector of SpillMultiVars, one per column.
+     */
+    template<class Selection>
+        std::vector<ana::SpillMultiVar> book_fused_vars(SampleProfile * profile = nullptr, const std::string & tree = "")
+        {
+            std::shared_ptr<Selection> selection(std::make_shared<Selection>(profile, tree));
+            std::vector<ana::SpillMultiVar> result;
+            for(size_t c(0); c < Selection::Names().size(); ++c)
+            {
+                result.push_back(ana::SpillMultiVar([selection, c](const caf::SRSpillProxy * sr)
+                {
+                    return utilities::release_buffer(selection->Get(sr, c));
+                }));
+            }
+            return result;
+        }
+}
+#endif // REGISTRY_H
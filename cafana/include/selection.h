@@ -0,0 +1,343 @@
+/**
+ * @file selection.h
+ * @brief Header file for the shared-selection machinery used by the Analysis
+ * class to build "selected" trees.
+ * @details A selected tree is a set of variables (columns) that are all
+ * evaluated over the same set of interactions, as defined by a single
+ * interaction cut and (optionally) a truth category cut. The preprocessor
+ * macros in preprocessor.h re-evaluate the cut and the truth matching once
+ * per column, which for trees with tens of columns means the selection is
+ * run tens of times per spill. The classes in this file instead evaluate the
+ * selection once per spill, cache the list of passing interactions (with
+ * their matches), and then evaluate each column over the cached list.
+ * @author mueller@fnal.gov
+ */
+#ifndef SELECTION_H
+#define SELECTION_H
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+
+#include "sbnana/CAFAna/Core/MultiVar.h"
+#include "sbnanaobj/StandardRecord/Proxy/SRProxy.h"
+
+#include "include/utilities.h"
+
+namespace ana
+{
+    /**
+     * @brief Type definitions for cuts and variables acting on a single reco
+     * or true interaction.
+     */
+    typedef std::function<bool(const caf::SRInteractionDLPProxy &)> RecoCut;
+    typedef std::function<bool(const caf::SRInteractionTruthDLPProxy &)> TrueCut;
+    typedef std::function<double(const caf::SRInteractionDLPProxy &)> RecoVar;
+    typedef std::function<double(const caf::SRInteractionTruthDLPProxy &)> TrueVar;
+
+    /**
+     * @brief Type definition for a cut acting on a full spill. Both plain
+     * functions and ana::SpillCut objects may be used.
+     */
+    typedef std::function<bool(const caf::SRSpillProxy *)> SpillPrecut;
+
+    /**
+     * @struct SelectedVar
+     * @brief Struct to store a single column of a selected tree.
+     * @details A column is a named variable that is evaluated either on the
+     * reco interaction or on the true interaction of each selected candidate.
+     * Exactly one of the two functions is expected to be set. If the column
+     * acts on the true interaction and the candidate has no match, the
+     * column is filled with utilities::kUnmatched (the same convention as
+     * SPINEVAR_RT).
+     */
+    struct SelectedVar
+    {
+        std::string name;
+        RecoVar reco;
+        TrueVar truth;
+    };
+
+    /**
+     * @struct Candidate
+     * @brief Struct to store a single selected candidate in a spill.
+     * @details The candidate is stored as the index of the reco interaction
+     * and the index of the true interaction within the spill. An index of -1
+     * indicates that the corresponding interaction does not exist (e.g. a
+     * reco interaction without a match).
+     */
+    struct Candidate
+    {
+        int64_t reco;
+        int64_t truth;
+    };
+
+    /**
+     * @class SpillSelection
+     * @brief Class that evaluates a selection once per spill and caches the
+     * resulting list of candidates.
+     * @details The selection is either reco-driven (loop over the reco
+     * interactions, select with the reco cut, and require the matched true
+     * interaction to pass the truth cut if the sample is simulation) or
+     * truth-driven (loop over the true interactions, select with the truth
+     * cut, and require a match). These are the same semantics as the
+     * SPINEVAR_RR/RT and SPINEVAR_TT/TR macros, respectively.
+     * @note The cache is keyed on the index of the current spill (see
+     * utilities::current_spill()), which is set by the first column of each
+     * Tree (see @ref track_spills()), so it does not depend on the order in
+     * which the columns of a spill are evaluated. Each instance must be
+     * shared only by the columns of Trees on a single loader.
+     */
+    class SpillSelection
+    {
+        public:
+            SpillSelection(RecoCut cut, TrueCut truth_cut);
+            SpillSelection(TrueCut truth_cut);
+            const std::vector<Candidate> & Get(const caf::SRSpillProxy * sr);
+        private:
+            void Evaluate(const caf::SRSpillProxy * sr);
+            RecoCut cut;
+            TrueCut truth_cut;
+            bool truth_driven;
+            uint64_t spill;
+            std::vector<Candidate> candidates;
+    };
+
+    /**
+     * @brief Constructor for a reco-driven SpillSelection.
+     * @param cut The cut applied to each reco interaction.
+     * @param truth_cut The cut applied to the true interaction matched to by
+     * each reco interaction (simulation only).
+     * @return A new instance of the SpillSelection class.
+     */
+    SpillSelection::SpillSelection(RecoCut cut, TrueCut truth_cut)
+        : cut(cut), truth_cut(truth_cut), truth_driven(false), spill(0) {}
+
+    /**
+     * @brief Constructor for a truth-driven SpillSelection.
+     * @param truth_cut The cut applied to each true interaction.
+     * @return A new instance of the SpillSelection class.
+     */
+    SpillSelection::SpillSelection(TrueCut truth_cut)
+        : truth_cut(truth_cut), truth_driven(true), spill(0) {}
+
+    /**
+     * @brief Retrieve the candidates of the current spill.
+     * @details The selection is evaluated on the first call of any column in
+     * a new spill. Subsequent calls in the same spill return the cached
+     * list of candidates. If no spill is active (see
+     * utilities::enter_spill()), the selection is evaluated on each call.
+     * @param sr The spill to retrieve the candidates for.
+     * @return The list of selected candidates in the spill.
+     */
+    const std::vector<Candidate> & SpillSelection::Get(const caf::SRSpillProxy * sr)
+    {
+        uint64_t current(utilities::current_spill());
+        if(current == 0 || current != spill)
+        {
+            Evaluate(sr);
+            spill = current;
+        }
+        return candidates;
+    }
+
+    /**
+     * @brief Evaluate the selection on the spill.
+     * @details The candidate list is cleared (but its capacity retained) and
+     * refilled with the interactions passing the selection. The per-spill
+     * cache of interaction summaries is (re)started here, so the columns and
+     * the cuts share the same @ref utilities::Summary of each interaction,
+     * and the matches are taken from the @ref utilities::MatchTable of the
+     * spill.
+     * @param sr The spill to evaluate the selection on.
+     * @return void
+     */
+    void SpillSelection::Evaluate(const caf::SRSpillProxy * sr)
+    {
+        const utilities::MatchTable & m(utilities::match_table(sr));
+        candidates.clear();
+        if(truth_driven)
+        {
+            for(size_t i(0); i < sr->dlp_true.size(); ++i)
+            {
+                if(truth_cut(sr->dlp_true[i]) && m.true_to_reco[i] >= 0)
+                    candidates.push_back({m.true_to_reco[i], int64_t(i)});
+            }
+        }
+        else
+        {
+            bool is_mc(sr->ndlp_true != 0);
+            for(size_t i(0); i < sr->dlp.size(); ++i)
+            {
+                if(!cut(sr->dlp[i]))
+                    continue;
+                int64_t t(m.reco_to_true[i]);
+                if((t >= 0 && truth_cut(sr->dlp_true[t])) || !is_mc)
+                    candidates.push_back({int64_t(i), t});
+            }
+        }
+    }
+
+    /**
+     * @brief Book the SpillMultiVars implementing the columns of a selected
+     * tree on a single loader.
+     * @details This function connects a fresh SpillSelection shared by all the
+     * columns, and one SpillMultiVar per column that evaluates the column on
+     * each of the cached candidates of the spill. Each column owns a reusable
+     * output buffer that is refilled in place and moved into the result (see
+     * utilities::release_buffer()), so only the exactly-sized result is
+     * allocated per spill.
+     * @param selection The (fresh) selection shared by the columns.
+     * @param vars The columns of the tree.
+     * @return A vector of SpillMultiVars, one per column.
+     */
+    std::vector<ana::SpillMultiVar> book_selected_vars(std::shared_ptr<SpillSelection> selection, const std::vector<SelectedVar> & vars)
+    {
+        std::vector<ana::SpillMultiVar> result;
+        for(size_t c(0); c < vars.size(); ++c)
+        {
+            const SelectedVar & v(vars[c]);
+            std::shared_ptr<std::vector<double>> buffer(std::make_shared<std::vector<double>>());
+            result.push_back(ana::SpillMultiVar([selection, v, buffer](const caf::SRSpillProxy * sr)
+            {
+                const std::vector<Candidate> & candidates(selection->Get(sr));
+                std::vector<double> & var(*buffer);
+                var.clear();
+                for(const Candidate & k : candidates)
+                {
+                    if(v.reco)
+                        var.push_back(k.reco >= 0 ? v.reco(sr->dlp[k.reco]) : utilities::kUnmatched);
+                    else
+                        var.push_back(k.truth >= 0 ? v.truth(sr->dlp_true[k.truth]) : utilities::kUnmatched);
+                }
+                return utilities::release_buffer(var);
+            }));
+        }
+        return result;
+    }
+
+    /**
+     * @class SpillPreselection
+     * @brief Class that evaluates a spill-level preselection once per spill
+     * and gates all the columns of a tree on it.
+     * @details Each column of a tree built with the SPINEVAR macros loops over
+     * all interactions of the spill, even if none of them can pass the cut of
+     * the tree. A cheap spill-level preselection that is implied by the cut
+     * of the tree (e.g. "any interaction has a valid flash match") rejects
+     * such spills once, before any column is evaluated. The preselection is
+     * cached per spill using the same spill index (and the same
+     * restrictions) as @ref SpillSelection.
+     */
+    class SpillPreselection
+    {
+        public:
+            SpillPreselection(SpillPrecut cut);
+            bool Pass(const caf::SRSpillProxy * sr);
+        private:
+            SpillPrecut cut;
+            uint64_t spill;
+            bool pass;
+    };
+
+    /**
+     * @brief Constructor for the SpillPreselection class.
+     * @param cut The spill-level preselection.
+     * @return A new instance of the SpillPreselection class.
+     */
+    SpillPreselection::SpillPreselection(SpillPrecut cut)
+        : cut(cut), spill(0), pass(false) {}
+
+    /**
+     * @brief Check if the current spill passes the preselection.
+     * @details The preselection is evaluated on the first call of any column
+     * in a new spill. Subsequent calls in the same spill return the cached
+     * result. If no spill is active (see utilities::enter_spill()), the
+     * preselection is evaluated on each call.
+     * @param sr The spill to check.
+     * @return True if the spill passes the preselection.
+     */
+    bool SpillPreselection::Pass(const caf::SRSpillProxy * sr)
+    {
+        uint64_t current(utilities::current_spill());
+        if(current == 0 || current != spill)
+        {
+            pass = cut(sr);
+            spill = current;
+        }
+        return pass;
+    }
+
+    /**
+     * @brief Create a spill-level preselection requiring at least one reco
+     * interaction passing a cut.
+     * @details The preselection is evaluated within the spill registered
+     * with the Summary cache (see @ref track_spills()), so cuts using the
+     * Summary of an interaction share it with the columns evaluated
+     * afterwards.
+     * @param cut The cut applied to each reco interaction.
+     * @return The spill-level preselection.
+     */
+    SpillPrecut any_interaction(RecoCut cut)
+    {
+        return [cut](const caf::SRSpillProxy * sr)
+        {
+            for(auto const & r : sr->dlp)
+            {
+                if(cut(r))
+                    return true;
+            }
+            return false;
+        };
+    }
+
+    /**
+     * @brief Gate the SpillMultiVars implementing the columns of a tree on a
+     * spill-level preselection.
+     * @details Each column returns no entries for spills failing the
+     * preselection, without evaluating the wrapped SpillMultiVar. All
+     * columns of the tree are gated by the same preselection, so the
+     * columns of a tree either all or none produce entries in a spill.
+     * @param preselection The (fresh) preselection shared by the columns.
+     * @param vars The columns of the tree.
+     * @return A vector of SpillMultiVars, one per column.
+     */
+    std::vector<ana::SpillMultiVar> book_preselected_vars(std::shared_ptr<SpillPreselection> preselection, const std::vector<ana::SpillMultiVar> & vars)
+    {
+        std::vector<ana::SpillMultiVar> result;
+        for(size_t c(0); c < vars.size(); ++c)
+        {
+            ana::SpillMultiVar v(vars[c]);
+            result.push_back(ana::SpillMultiVar([preselection, v](const caf::SRSpillProxy * sr)
+            {
+                if(!preselection->Pass(sr))
+                    return std::vector<double>();
+                return v(sr);
+            }));
+        }
+        return result;
+    }
+
+    /**
+     * @brief Register the spills seen by a Tree with the Summary cache.
+     * @details The wrapped SpillMultiVar must be the first column of the
+     * Tree and must be called exactly once per spill. It counts the spills
+     * of the Tree and enters the spill with that count as its index (see
+     * utilities::enter_spill()) before any other column is evaluated. All
+     * Trees of a sample see the same sequence of spills, so the first Tree
+     * evaluated in a spill starts it and the others find it active. The
+     * count is owned by the returned SpillMultiVar, so it must be booked
+     * afresh for each sample (after utilities::reset_spills()).
+     * @param var The first column of the Tree.
+     * @return The wrapped column.
+     */
+    ana::SpillMultiVar track_spills(const ana::SpillMultiVar & var)
+    {
+        std::shared_ptr<uint64_t> spills(std::make_shared<uint64_t>(0));
+        return ana::SpillMultiVar([var, spills](const caf::SRSpillProxy * sr)
+        {
+            utilities::enter_spill(++*spills);
+            return var(sr);
+        });
+    }
+}
+#endif // SELECTION_H
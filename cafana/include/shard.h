@@ -0,0 +1,223 @@
+/**
+ * @file shard.h
+ * @brief Header file for the sharding of Analysis jobs and the merging of the
+ * outputs of the shards.
+ * @details In shard mode (see Analysis::SetShard()), shard i of N processes
+ * the i-th of N contiguous blocks of the (sorted) input files of each sample
+ * and writes its own output file. Because the blocks are contiguous, the
+ * entries of the shards concatenated in shard order are in the same order as
+ * those of a single-process run over the same files. This file provides the
+ * partitioning of the input files, the naming of the shard outputs, and the
+ * merging of the shard outputs into a single output file, in which the Trees
+ * of each sample are concatenated and the exposure histograms (POT and
+ * Livetime) are summed.
+ * @author mueller@fnal.gov
+ */
+#ifndef SHARD_H
+#define SHARD_H
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+
+#include "TFile.h"
+#include "TDirectory.h"
+#include "TKey.h"
+#include "TList.h"
+#include "TTree.h"
+#include "TH1.h"
+#include "TNamed.h"
+
+#include "include/columnar.h"
+#include "include/cache.h"
+
+namespace ana
+{
+    /**
+     * @brief Select the input files of a shard.
+     * @details The files are split into count contiguous blocks whose sizes
+     * differ by at most one, and the block of the shard is returned. Shards
+     * beyond the number of files receive no files.
+     * @param files The (sorted) input files of the sample (see
+     * @ref expand_source()).
+     * @param index The index of the shard.
+     * @param count The number of shards.
+     * @return The input files of the shard.
+     */
+    std::vector<std::string> shard_files(const std::vector<std::string> & files, size_t index, size_t count)
+    {
+        size_t begin(files.size() * index / count), end(files.size() * (index + 1) / count);
+        return std::vector<std::string>(files.begin() + begin, files.begin() + end);
+    }
+
+    /**
+     * @brief Get the name (without extension) of the output of a shard.
+     * @param name The name of the Analysis.
+     * @param index The index of the shard.
+     * @param count The number of shards.
+     * @return The name of the output of the shard.
+     */
+    std::string shard_output_name(const std::string & name, size_t index, size_t count)
+    {
+        return name + "_shard" + std::to_string(index) + "of" + std::to_string(count);
+    }
+
+    /**
+     * @brief Parse a shard specification of the form "i/N".
+     * @param spec The shard specification.
+     * @param index The index of the shard (output).
+     * @param count The number of shards (output).
+     * @return void
+     * @throw std::invalid_argument if the specification is malformed.
+     */
+    void parse_shard(const std::string & spec, size_t & index, size_t & count)
+    {
+        size_t slash(spec.find('/'));
+        if(slash == std::string::npos)
+            throw std::invalid_argument("Invalid shard specification " + spec + " (expected i/N).");
+        index = std::stoul(spec.substr(0, slash));
+        count = std::stoul(spec.substr(slash + 1));
+        if(count == 0 || index >= count)
+            throw std::invalid_argument("Invalid shard specification " + spec + " (expected 0 <= i < N).");
+    }
+
+    /**
+     * @brief Merge the outputs of the shards of an Analysis.
+     * @details For each sample directory of "events", the Trees of all
+     * shards are concatenated in shard order, and the histograms (the POT
+     * and Livetime exposure of each sample) are summed. The manifests of the
+     * shards are not merged, and neither are any other directories (e.g. the
+     * profiles). If requested, the merged Trees are also exported as columns
+     * (see @ref write_columns()), with the columns of a friend tree added to
+     * the export of its Tree. The previous export of each merged sample is
+     * removed, and the new export is stamped (see @ref make_column_stamp()).
+     * @param name The name of the Analysis (the output is "<name>.root").
+     * @param count The number of shards.
+     * @param columnar Whether to export the merged Trees as columns.
+     * @param compact Whether to write the (double) columns as float32.
+     * @return void
+     * @throw std::runtime_error if the output of a shard is missing.
+     */
+    void merge_shards(const std::string & name, size_t count, bool columnar = false, bool compact = false)
+    {
+        std::vector<TFile *> shards;
+        for(size_t i(0); i < count; ++i)
+        {
+            std::string path(shard_output_name(name, i, count) + ".root");
+            TFile * f = TFile::Open(path.c_str(), "READ");
+            if(!f || f->IsZombie())
+                throw std::runtime_error("Missing output of shard " + path + ".");
+            shards.push_back(f);
+        }
+
+        /**
+         * @brief Collect the objects of each sample over the shards.
+         * @details Samples (and their objects) are merged in the order they
+         * first appear, so a sample without any input files in the first
+         * shards is still merged. Only the highest cycle of each key is used.
+         */
+        std::vector<std::string> samples;
+        std::map<std::string, std::vector<std::string>> order;
+        std::map<std::string, std::map<std::string, TList>> trees;
+        std::map<std::string, std::map<std::string, TH1 *>> hists;
+        for(TFile * f : shards)
+        {
+            TDirectory * dir = f->GetDirectory("events");
+            if(!dir)
+                continue;
+            TIter next_sample(dir->GetListOfKeys());
+            TKey * skey;
+            while((skey = (TKey *) next_sample()))
+            {
+                std::string sample(skey->GetName());
+                TDirectory * sdir = dir->GetDirectory(sample.c_str());
+                if(!sdir)
+                    continue;
+                if(order.find(sample) == order.end())
+                    samples.push_back(sample);
+                std::vector<std::string> & names(order[sample]);
+                std::set<std::string> seen;
+                TIter next(sdir->GetListOfKeys());
+                TKey * key;
+                while((key = (TKey *) next()))
+                {
+                    std::string k(key->GetName());
+                    if(!seen.insert(k).second || k == "manifest")
+                        continue;
+                    TObject * object = key->ReadObj();
+                    if(TTree * tree = dynamic_cast<TTree *>(object))
+                    {
+                        if(std::find(names.begin(), names.end(), k) == names.end())
+                            names.push_back(k);
+                        trees[sample][k].Add(tree);
+                    }
+                    else if(TH1 * h = dynamic_cast<TH1 *>(object))
+                    {
+                        if(std::find(names.begin(), names.end(), k) == names.end())
+                            names.push_back(k);
+                        TH1 *& sum(hists[sample][k]);
+                        if(!sum)
+                        {
+                            sum = (TH1 *) h->Clone(k.c_str());
+                            sum->SetDirectory(nullptr);
+                        }
+                        else
+                            sum->Add(h);
+                        delete h;
+                    }
+                    else
+                        delete object;
+                }
+            }
+        }
+
+        /**
+         * @brief Write the merged objects of each sample.
+         */
+        std::string path(name + ".root");
+        TFile * output = new TFile(path.c_str(), "RECREATE");
+        TDirectory * events = output->mkdir("events");
+        for(const std::string & sample : samples)
+        {
+            TDirectory * sdir = events->mkdir(sample.c_str());
+            std::string export_path(name + ".columns/" + sample);
+            std::string stamp(columnar ? make_column_stamp() : "");
+            if(columnar)
+                remove_columns(export_path);
+            for(const std::string & k : order[sample])
+            {
+                if(hists[sample].count(k))
+                {
+                    sdir->WriteObject(hists[sample][k], k.c_str());
+                    delete hists[sample][k];
+                    continue;
+                }
+                sdir->cd();
+                TTree * merged = TTree::MergeTrees(&trees[sample][k]);
+                merged->SetName(k.c_str());
+                sdir->WriteObject(merged, k.c_str());
+                if(columnar)
+                {
+                    std::string base(k);
+                    if(base.size() > 7 && base.compare(base.size() - 7, 7, "_friend") == 0)
+                        base.resize(base.size() - 7);
+                    write_columns(merged, export_path + "/" + base, compact);
+                }
+                delete merged;
+            }
+            if(columnar)
+            {
+                write_column_stamp(export_path, stamp);
+                sdir->WriteTObject(new TNamed("columns", stamp.c_str()), "columns");
+            }
+            std::cout << "Merged sample " << sample << " of " << count << " shards." << std::endl;
+        }
+        output->Close();
+        for(TFile * f : shards)
+            f->Close();
+    }
+}
+#endif // SHARD_H
@@ -0,0 +1,191 @@
+/**
+ * @file skim.h
+ * @brief Header file for the skimming of CAF files to the spills passing a
+ * loose spill-level preselection.
+ * @details Most spills of a sample contain no interaction that can pass the
+ * selection of an analysis, but every run over the sample still reads and
+ * evaluates all of them. A skim is a reduced copy of each input file whose
+ * "recTree" only holds the spills passing a loose preselection (see
+ * @ref SpillPrecut), which must be implied by all selections later run over
+ * the skim. The exposure (POT and livetime) of the full input file is stored
+ * in the "skim" directory of the skimmed file, so that an analysis run over
+ * the skim (see Analysis::AddSkim()) can report the exposure of the full
+ * sample instead of the exposure of the kept spills.
+ * @author mueller@fnal.gov
+ */
+#ifndef SKIM_H
+#define SKIM_H
+#include <vector>
+#include <string>
+#include <set>
+#include <memory>
+#include <stdexcept>
+#include <iostream>
+
+#include "sbnana/CAFAna/Core/SpectrumLoader.h"
+#include "sbnana/CAFAna/Core/Tree.h"
+#include "sbnana/CAFAna/Core/MultiVar.h"
+#include "sbnanaobj/StandardRecord/Proxy/SRProxy.h"
+
+#include "TFile.h"
+#include "TMemFile.h"
+#include "TDirectory.h"
+#include "TKey.h"
+#include "TTree.h"
+#include "TH1.h"
+
+#include "include/selection.h"
+#include "include/cache.h"
+
+namespace ana
+{
+    /**
+     * @brief Skim a single CAF file.
+     * @details The input file is first run through CAFAna, recording the
+     * (run, subrun, event) of each spill passing the preselection and the
+     * exposure of the full file. The "recTree" of the input file is then
+     * copied entry-by-entry, keeping the recorded spills. The spills are
+     * matched in file order, so repeated event numbers are handled
+     * correctly, and only the header branches are read for the rejected
+     * spills. All other top-level objects of the input file are copied as
+     * they are. A skimmed file may be skimmed again with a tighter
+     * preselection, in which case its stored exposure is carried over.
+     * @param input The path of the input CAF file.
+     * @param output The path of the skimmed CAF file.
+     * @param cut The spill-level preselection.
+     * @return The number of spills kept.
+     * @throw std::runtime_error if the input file has no "recTree" or if the
+     * recorded spills can not be matched to its entries.
+     */
+    size_t skim_file(const std::string & input, const std::string & output, SpillPrecut cut)
+    {
+        /**
+         * @brief Record the spills passing the preselection. The header of
+         * the spill is gated on the preselection like the columns of a Tree
+         * (see @ref SpillPreselection), so it is evaluated once per spill.
+         */
+        std::vector<ana::SpillMultiVar> header = {
+            ana::SpillMultiVar([](const caf::SRSpillProxy * sr) { return std::vector<double>{double(sr->hdr.run)}; }),
+            ana::SpillMultiVar([](const caf::SRSpillProxy * sr) { return std::vector<double>{double(sr->hdr.subrun)}; }),
+            ana::SpillMultiVar([](const caf::SRSpillProxy * sr) { return std::vector<double>{double(sr->hdr.evt)}; })
+        };
+        header = book_preselected_vars(std::make_shared<SpillPreselection>(cut), header);
+        header[0] = track_spills(header[0]);
+        ana::SpectrumLoader loader(input);
+        ana::Tree spills("skim", {"run", "subrun", "evt"}, loader, header, ana::kNoSpillCut, true);
+        utilities::reset_spills();
+        loader.Go();
+        utilities::reset_spills();
+        TMemFile scratch((output + "_scratch.root").c_str(), "RECREATE");
+        spills.SaveTo(&scratch);
+        TTree * kept = scratch.Get<TTree>("skim");
+        TH1 * pot = scratch.Get<TH1>("POT");
+        TH1 * livetime = scratch.Get<TH1>("Livetime");
+        double run, subrun, evt;
+        kept->SetBranchAddress("run", &run);
+        kept->SetBranchAddress("subrun", &subrun);
+        kept->SetBranchAddress("evt", &evt);
+
+        /**
+         * @brief Copy the kept spills of the input file.
+         */
+        TFile * in = TFile::Open(input.c_str(), "READ");
+        TTree * tree = in ? in->Get<TTree>("recTree") : nullptr;
+        if(!tree)
+            throw std::runtime_error("Missing recTree in input file " + input + ".");
+        unsigned int hdr_run, hdr_subrun, hdr_evt;
+        tree->SetBranchAddress("rec.hdr.run", &hdr_run);
+        tree->SetBranchAddress("rec.hdr.subrun", &hdr_subrun);
+        tree->SetBranchAddress("rec.hdr.evt", &hdr_evt);
+        TBranch * b_run = tree->GetBranch("rec.hdr.run");
+        TBranch * b_subrun = tree->GetBranch("rec.hdr.subrun");
+        TBranch * b_evt = tree->GetBranch("rec.hdr.evt");
+
+        TFile * out = new TFile(output.c_str(), "RECREATE");
+        TTree * skimmed = tree->CloneTree(0);
+        long long next(0), nkept(kept->GetEntries());
+        if(nkept > 0)
+            kept->GetEntry(next);
+        for(long long i(0); i < tree->GetEntries() && next < nkept; ++i)
+        {
+            b_run->GetEntry(i);
+            b_subrun->GetEntry(i);
+            b_evt->GetEntry(i);
+            if(hdr_run != run || hdr_subrun != subrun || hdr_evt != evt)
+                continue;
+            tree->GetEntry(i);
+            skimmed->Fill();
+            if(++next < nkept)
+                kept->GetEntry(next);
+        }
+        if(next != nkept)
+            throw std::runtime_error("Matched " + std::to_string(next) + " of " + std::to_string(nkept) + " skimmed spills in input file " + input + ".");
+        out->WriteObject(skimmed, "recTree");
+
+        /**
+         * @brief Copy the other top-level objects and store the exposure of
+         * the full input file.
+         */
+        TDirectory * previous = in->GetDirectory("skim");
+        if(previous)
+        {
+            pot = previous->Get<TH1>("POT");
+            livetime = previous->Get<TH1>("Livetime");
+        }
+        std::set<std::string> copied = {"recTree", "skim"};
+        TIter next_key(in->GetListOfKeys());
+        TKey * key;
+        while((key = (TKey *) next_key()))
+        {
+            if(!copied.insert(key->GetName()).second)
+                continue;
+            TObject * object = key->ReadObj();
+            if(TDirectory * dir = dynamic_cast<TDirectory *>(object))
+                copy_directory(dir, out->mkdir(key->GetName()));
+            else
+            {
+                out->WriteTObject(object, key->GetName());
+                delete object;
+            }
+        }
+        TDirectory * exposure = out->mkdir("skim");
+        exposure->WriteObject(pot, "POT");
+        exposure->WriteObject(livetime, "Livetime");
+        std::cout << "Skimmed " << input << ": kept " << nkept << " of " << tree->GetEntries() << " spills." << std::endl;
+        out->Close();
+        in->Close();
+        scratch.Close();
+        return nkept;
+    }
+
+    /**
+     * @brief Sum the exposure of the full input files of a set of skimmed
+     * CAF files (see @ref skim_file()).
+     * @param files The paths of the skimmed CAF files.
+     * @param name The name of the exposure histogram ("POT" or "Livetime").
+     * @return The summed histogram (owned by the caller), or nullptr if there
+     * are no files.
+     * @throw std::runtime_error if a file is not a skimmed CAF file.
+     */
+    TH1 * skim_exposure(const std::vector<std::string> & files, const std::string & name)
+    {
+        TH1 * sum = nullptr;
+        for(const std::string & path : files)
+        {
+            TFile * f = TFile::Open(path.c_str(), "READ");
+            TH1 * h = f ? f->Get<TH1>(("skim/" + name).c_str()) : nullptr;
+            if(!h)
+                throw std::runtime_error("Missing skim exposure " + name + " in file " + path + ".");
+            if(!sum)
+            {
+                sum = (TH1 *) h->Clone(name.c_str());
+                sum->SetDirectory(nullptr);
+            }
+            else
+                sum->Add(h);
+            f->Close();
+        }
+        return sum;
+    }
+}
+#endif // SKIM_H
@@ -0,0 +1,257 @@
+/**
+ * @file storage.h
+ * @brief Header file for the storage types of the columns of the Trees
+ * written by the Analysis class.
+ * @details All variables are computed as doubles, but the TTrees of the
+ * output file may store each column with a smaller type (see
+ * @ref ana::ColumnType). This file provides the storage types, the layout of
+ * the branches of a typed TTree, which is shared by the streaming trees (see
+ * stream.h) and by the conversion of the (double) TTrees written by an
+ * ana::Tree. It only depends on ROOT, so the layout may also be used by the
+ * readers of the output (e.g. the tests of the systematics framework).
+ * @author mueller@fnal.gov
+ */
+#ifndef STORAGE_H
+#define STORAGE_H
+#include <vector>
+#include <string>
+#include <map>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+#include "TDirectory.h"
+#include "TTree.h"
+#include "TBranch.h"
+#include "TLeaf.h"
+#include "TObjArray.h"
+
+namespace ana
+{
+    /**
+     * @enum ColumnType
+     * @brief Enumeration of the storage types of the columns of a Tree.
+     * @details All variables are computed as doubles, but flags, categories,
+     * and identifiers are exactly representable by smaller integer types,
+     * and single precision is sufficient for the kinematic variables.
+     * Integer values are rounded to the nearest integer. A value that the
+     * type cannot represent (see @ref representable()) is rejected, so a
+     * column that may hold utilities::kUnmatched (-1) cannot be a Bool.
+     */
+    enum class ColumnType { Bool, Int8, Int32, Float, Double };
+
+    /**
+     * @brief Type definition for the storage types of the columns of a Tree,
+     * keyed by the name of the column. The type of the empty name is the
+     * default type of the columns of the Tree (double if unset).
+     */
+    typedef std::map<std::string, ColumnType> column_types_t;
+
+    /**
+     * @brief Get the storage type of a column.
+     * @details The Run, Subrun, and Evt identifying an entry are not columns
+     * and are always stored as Int_t (see @ref book_typed_branches()). The
+     * nu_id is not affected by the default type of the Tree (it is stored as
+     * a double unless it is given a type explicitly), so a small default
+     * type never truncates it. All readers of the
+     * identifiers (see @ref read_entry_keys() and the systematics framework)
+     * read them through their leaves, so they do not depend on the type.
+     * @param types The storage types of the columns of the Tree.
+     * @param name The name of the column.
+     * @return The storage type of the column.
+     */
+    ColumnType column_type(const column_types_t & types, const std::string & name)
+    {
+        column_types_t::const_iterator it(types.find(name));
+        if(it == types.end() && name == "nu_id")
+            return ColumnType::Double;
+        if(it == types.end())
+            it = types.find("");
+        return it == types.end() ? ColumnType::Double : it->second;
+    }
+
+    /**
+     * @brief Check whether any column of a Tree has a storage type other than
+     * double.
+     * @param types The storage types of the columns of the Tree.
+     * @param names The names of the columns.
+     * @return True if any column is not stored as a double.
+     */
+    bool has_column_types(const column_types_t & types, const std::vector<std::string> & names)
+    {
+        for(const std::string & n : names)
+        {
+            if(column_type(types, n) != ColumnType::Double)
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Get the name of a storage type.
+     * @param type The storage type.
+     * @return The name of the storage type.
+     */
+    std::string column_type_name(ColumnType type)
+    {
+        switch(type)
+        {
+            case ColumnType::Bool: return "bool";
+            case ColumnType::Int8: return "int8";
+            case ColumnType::Int32: return "int32";
+            case ColumnType::Float: return "float";
+            default: return "double";
+        }
+    }
+
+    /**
+     * @brief Get the ROOT leaf type code of a storage type.
+     * @param type The storage type.
+     * @return The leaf type code (e.g. "D" for a double).
+     */
+    std::string leaf_code(ColumnType type)
+    {
+        switch(type)
+        {
+            case ColumnType::Bool: return "O";
+            case ColumnType::Int8: return "B";
+            case ColumnType::Int32: return "I";
+            case ColumnType::Float: return "F";
+            default: return "D";
+        }
+    }
+
+    /**
+     * @brief Check whether a value is representable by a storage type.
+     * @details A Bool represents only 0 and 1, and the integer types the
+     * finite values that round to an integer within their range. The
+     * floating-point types represent any value (in single precision for a
+     * Float).
+     * @param type The storage type.
+     * @param value The value to check.
+     * @return True if the value is representable.
+     */
+    bool representable(ColumnType type, double value)
+    {
+        switch(type)
+        {
+            case ColumnType::Bool: return value == 0 || value == 1;
+            case ColumnType::Int8: return std::isfinite(value) && std::round(value) >= INT8_MIN && std::round(value) <= INT8_MAX;
+            case ColumnType::Int32: return std::isfinite(value) && std::round(value) >= INT32_MIN && std::round(value) <= INT32_MAX;
+            default: return true;
+        }
+    }
+
+    /**
+     * @brief Store a value with a storage type.
+     * @param type The storage type.
+     * @param address The (8-byte) storage of the value.
+     * @param value The value to store.
+     * @param column The name of the column (used in the error message).
+     * @return void
+     * @throw std::runtime_error if the value is not representable by the
+     * storage type (see @ref representable()).
+     */
+    void store_value(ColumnType type, void * address, double value, const std::string & column)
+    {
+        if(!representable(type, value))
+            throw std::runtime_error("Value " + std::to_string(value) + " of column " + column + " is not representable as " + column_type_name(type) + ".");
+        switch(type)
+        {
+            case ColumnType::Bool: *static_cast<bool *>(address) = value != 0; break;
+            case ColumnType::Int8: *static_cast<int8_t *>(address) = int8_t(std::lround(value)); break;
+            case ColumnType::Int32: *static_cast<int32_t *>(address) = int32_t(std::lround(value)); break;
+            case ColumnType::Float: *static_cast<float *>(address) = float(value); break;
+            default: *static_cast<double *>(address) = value; break;
+        }
+    }
+
+    /**
+     * @brief Create the branches of a typed TTree.
+     * @details The TTree has one branch per column (with the storage type of
+     * the column), followed by the Run, Subrun, and Evt branches of type
+     * Int_t. This is the layout of the TTrees written by an ana::Tree, which
+     * the systematics framework relies on (see sys::trees::read_selection()).
+     * @param tree The TTree to create the branches of.
+     * @param names The names of the columns.
+     * @param types The storage types of the columns.
+     * @param values The (8-byte) storage of each column (one per column).
+     * @param ids The storage of the Run, Subrun, and Evt (three values).
+     * @param basket_size The basket size (bytes) of each branch.
+     * @return The created branches (in order).
+     */
+    std::vector<TBranch *> book_typed_branches(TTree * tree, const std::vector<std::string> & names, const std::vector<ColumnType> & types, std::vector<uint64_t> & values, Int_t * ids, int basket_size = 32000)
+    {
+        std::vector<TBranch *> branches;
+        for(size_t c(0); c < names.size(); ++c)
+            branches.push_back(tree->Branch(names[c].c_str(), &values[c], (names[c] + "/" + leaf_code(types[c])).c_str(), basket_size));
+        const char * identifiers[3] = {"Run", "Subrun", "Evt"};
+        for(size_t k(0); k < 3; ++k)
+            branches.push_back(tree->Branch(identifiers[k], ids + k, (std::string(identifiers[k]) + "/I").c_str(), basket_size));
+        return branches;
+    }
+
+    /**
+     * @brief Write a copy of a TTree with the storage types of its columns.
+     * @details The values of the source TTree are read through the leaves
+     * of its branches, so the branches may have any numeric type. The
+     * converted TTree has the same columns in the same order, each with the
+     * storage type of its column (see @ref column_type()), followed by the
+     * Run, Subrun, and Evt as Int_t (see @ref book_typed_branches()).
+     * @param source The TTree to convert (e.g. as written by an ana::Tree).
+     * @param types The storage types of the columns.
+     * @param dir The directory to write the converted TTree to.
+     * @param name The name of the converted TTree.
+     * @return void
+     * @throw std::runtime_error if the source TTree has no Run, Subrun, or
+     * Evt branch.
+     */
+    void write_typed_tree(TTree * source, const column_types_t & types, TDirectory * dir, const std::string & name)
+    {
+        const char * identifiers[3] = {"Run", "Subrun", "Evt"};
+        TLeaf * id_leaves[3] = {nullptr, nullptr, nullptr};
+        std::vector<std::string> names;
+        std::vector<TLeaf *> leaves;
+        TObjArray * branches = source->GetListOfBranches();
+        for(int b(0); b < branches->GetEntries(); ++b)
+        {
+            std::string n(branches->At(b)->GetName());
+            size_t k(0);
+            while(k < 3 && n != identifiers[k])
+                ++k;
+            if(k < 3)
+                id_leaves[k] = source->GetLeaf(n.c_str());
+            else
+            {
+                names.push_back(n);
+                leaves.push_back(source->GetLeaf(n.c_str()));
+            }
+        }
+        for(size_t k(0); k < 3; ++k)
+        {
+            if(!id_leaves[k])
+                throw std::runtime_error("TTree " + name + " has no " + identifiers[k] + " branch.");
+        }
+        std::vector<ColumnType> t;
+        for(const std::string & n : names)
+            t.push_back(column_type(types, n));
+        std::vector<uint64_t> values(names.size(), 0);
+        Int_t ids[3] = {0, 0, 0};
+        dir->cd();
+        TTree * tree = new TTree(name.c_str(), name.c_str());
+        tree->SetDirectory(dir);
+        book_typed_branches(tree, names, t, values, ids);
+        for(Long64_t i(0); i < source->GetEntries(); ++i)
+        {
+            source->GetEntry(i);
+            for(size_t c(0); c < names.size(); ++c)
+                store_value(t[c], &values[c], leaves[c]->GetValue(0), names[c]);
+            for(size_t k(0); k < 3; ++k)
+                ids[k] = Int_t(id_leaves[k]->GetValue(0));
+            tree->Fill();
+        }
+        dir->WriteTObject(tree, name.c_str(), "WriteDelete");
+        delete tree;
+    }
+}
+#endif // STORAGE_H
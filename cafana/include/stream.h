@@ -0,0 +1,176 @@
+/**
+ * @file stream.h
+ * @brief Header file for the streaming of Trees to the output file used by
+ * the Analysis class to bound its memory usage.
+ * @details An ana::Tree holds all entries of a sample in memory until it is
+ * saved, so the memory usage of a sample grows with its size and with the
+ * number of columns of its Trees. A streaming tree instead evaluates the
+ * columns of a Tree once per spill and fills a TTree in the output file
+ * directly, which is flushed to the file incrementally according to its
+ * basket size and auto-flush setting. The columns are driven by a single
+ * SpillMultiVar attached to an ana::Tree that never receives any entries,
+ * so that the exposure (POT and livetime) of the sample is still accounted
+ * for by CAFAna. The columns are stored with their storage types (see
+ * storage.h).
+ * @author mueller@fnal.gov
+ */
+#ifndef STREAM_H
+#define STREAM_H
+#include <vector>
+#include <string>
+#include <mutex>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+#include "sbnana/CAFAna/Core/MultiVar.h"
+#include "sbnanaobj/StandardRecord/Proxy/SRProxy.h"
+
+#include "TDirectory.h"
+#include "TTree.h"
+#include "TBranch.h"
+
+#include "include/storage.h"
+
+namespace ana
+{
+    /**
+     * @struct WriteOptions
+     * @brief Struct to store the write settings of a streamed Tree.
+     * @details The compression setting follows the ROOT convention
+     * (100 * algorithm + level, e.g. 404 for LZ4 at level 4 or 505 for ZSTD
+     * at level 5), and a negative value keeps the setting of the output
+     * file. A negative auto-flush setting is a number of bytes and a positive
+     * one a number of entries (see TTree::SetAutoFlush()).
+     */
+    struct WriteOptions
+    {
+        int basket_size = 32000; ///< The basket size (bytes) of each branch.
+        int compression = -1; ///< The compression setting of each branch.
+        long long autoflush = -30000000; ///< The auto-flush setting of the TTree.
+    };
+
+    /**
+     * @class StreamingTree
+     * @brief Class filling the TTree of a Tree directly in the output file.
+     * @details Each entry holds the columns of the Tree (with their storage
+     * types) and the Run, Subrun, and Evt of its spill (as Int_t), which is
+     * the same layout as the TTree written by an ana::Tree for double
+     * columns (see @ref book_typed_branches()). The fill of each spill is
+     * guarded by the output mutex, since the baskets may be flushed to the
+     * output file shared with other samples.
+     */
+    class StreamingTree
+    {
+        public:
+            StreamingTree(const std::string & name, const std::vector<std::string> & names, const std::vector<ana::SpillMultiVar> & vars, const column_types_t & types, TDirectory * dir, const WriteOptions & options, std::mutex & output_mutex);
+            ana::SpillMultiVar Driver();
+            void Fill(const caf::SRSpillProxy * sr);
+            void Finish();
+        private:
+            std::string name;
+            std::vector<std::string> columns;
+            std::vector<ana::SpillMultiVar> vars;
+            std::vector<std::vector<double>> results;
+            std::vector<ColumnType> types;
+            std::vector<uint64_t> values;
+            std::array<Int_t, 3> ids;
+            TDirectory * dir;
+            TTree * tree;
+            std::mutex & output_mutex;
+    };
+
+    /**
+     * @brief Constructor for the StreamingTree class.
+     * @details The TTree is created in the directory of the sample with one
+     * branch per column (plus Run, Subrun, and Evt), using the basket size
+     * and compression setting of the options (see
+     * @ref book_typed_branches()).
+     * @param name The name of the Tree.
+     * @param names The names of the columns.
+     * @param vars The SpillMultiVars implementing the columns.
+     * @param types The storage types of the columns.
+     * @param dir The directory of the sample in the output file.
+     * @param options The write settings of the Tree.
+     * @param output_mutex The mutex guarding access to the output file.
+     * @return A new instance of the StreamingTree class.
+     */
+    StreamingTree::StreamingTree(const std::string & name, const std::vector<std::string> & names, const std::vector<ana::SpillMultiVar> & vars, const column_types_t & types, TDirectory * dir, const WriteOptions & options, std::mutex & output_mutex)
+        : name(name), columns(names), vars(vars), results(vars.size()), values(vars.size(), 0), ids{0, 0, 0}, dir(dir), output_mutex(output_mutex)
+    {
+        for(const std::string & n : names)
+            this->types.push_back(column_type(types, n));
+        std::lock_guard<std::mutex> lock(output_mutex);
+        dir->cd();
+        tree = new TTree(name.c_str(), name.c_str());
+        tree->SetDirectory(dir);
+        std::vector<TBranch *> branches(book_typed_branches(tree, names, this->types, values, ids.data(), options.basket_size));
+        if(options.compression >= 0)
+        {
+            for(TBranch * b : branches)
+                b->SetCompressionSettings(options.compression);
+        }
+        tree->SetAutoFlush(options.autoflush);
+    }
+
+    /**
+     * @brief Create the SpillMultiVar driving the Tree.
+     * @details The SpillMultiVar fills the entries of the spill and returns
+     * no entries itself, so the ana::Tree it is attached to stays empty.
+     * @return The driving SpillMultiVar.
+     */
+    ana::SpillMultiVar StreamingTree::Driver()
+    {
+        return ana::SpillMultiVar([this](const caf::SRSpillProxy * sr)
+        {
+            Fill(sr);
+            return std::vector<double>();
+        });
+    }
+
+    /**
+     * @brief Fill the entries of a spill.
+     * @details All columns are evaluated first, and the entries are then
+     * filled under the output mutex. Spills without any entries do not take
+     * the lock.
+     * @param sr The spill to fill the entries of.
+     * @return void
+     * @throw std::runtime_error if the columns have different numbers of
+     * entries in the spill.
+     */
+    void StreamingTree::Fill(const caf::SRSpillProxy * sr)
+    {
+        for(size_t c(0); c < vars.size(); ++c)
+        {
+            results[c] = vars[c](sr);
+            if(results[c].size() != results[0].size())
+                throw std::runtime_error("Columns of Tree " + name + " have different numbers of entries in a spill.");
+        }
+        if(results.empty() || results[0].empty())
+            return;
+        std::lock_guard<std::mutex> lock(output_mutex);
+        ids = {Int_t(sr->hdr.run), Int_t(sr->hdr.subrun), Int_t(sr->hdr.evt)};
+        for(size_t i(0); i < results[0].size(); ++i)
+        {
+            for(size_t c(0); c < vars.size(); ++c)
+                store_value(types[c], &values[c], results[c][i], columns[c]);
+            tree->Fill();
+        }
+    }
+
+    /**
+     * @brief Write the TTree and release it.
+     * @details The TTree replaces any previous cycles (e.g. those written by
+     * the auto-save), so the directory holds a single cycle of the Tree. The
+     * caller must hold the output mutex.
+     * @return void
+     */
+    void StreamingTree::Finish()
+    {
+        dir->WriteTObject(tree, name.c_str(), "WriteDelete");
+        delete tree;
+        tree = nullptr;
+    }
+
+}
+#endif // STREAM_H
@@ -13,6 +13,13 @@
 #define UTILITIES_H
 
 #include <vector>
+#include <array>
+#include <deque>
+#include <utility>
+#include <cstdint>
+#include <type_traits>
+
+#include "sbnanaobj/StandardRecord/Proxy/SRProxy.h"
 
 #include "include/particle_variables.h"
 #include "include/particle_cuts.h"
@@ -32,23 +39,392 @@
  */
 namespace utilities
 {
+    /**
+     * @struct Summary
+     * @brief Struct to store per-interaction quantities that are used by many
+     * variables and cuts.
+     * @details Many variables and cuts need the index of the leading particle
+     * of a given type or the count of final state primaries, each of which
+     * requires a full loop over the particles of the interaction. This struct
+     * stores the results of a single loop so that they can be shared by all
+     * variables and cuts evaluated on the interaction in the same spill.
+     * The same loop also takes a structure-of-arrays snapshot of the particle
+     * fields used by the variables, so that their loops over the particles
+     * run over contiguous arrays instead of through the proxies. The vector
+     * fields are stored per component (e.g. momentum[0] holds the x-component
+     * of the momentum of each particle), and use the truth fields for true
+     * interactions. They are single precision, like the CAF fields.
+     */
+    struct Summary
+    {
+        std::array<uint32_t, 5> counts; ///< Count of final state primaries per PID.
+        std::array<size_t, 5> leading; ///< Index of the leading particle per PID.
+        std::vector<double> energy; ///< Best energy estimate (@ref pvars::energy()) per particle.
+        std::vector<char> signal; ///< Final state signal flag (@ref pcuts::final_state_signal()) per particle.
+        std::vector<int> pid; ///< PID per particle.
+        std::vector<char> primary; ///< Primary flag per particle.
+        std::array<std::vector<float>, 3> momentum; ///< Momentum per component per particle.
+        std::array<std::vector<float>, 3> start_dir; ///< Start direction per component per particle.
+        std::array<std::vector<float>, 3> end_point; ///< End point per component per particle.
+    };
+
+    /**
+     * @brief Value of a variable of the true interaction matched to by a reco
+     * interaction without a match.
+     * @details Reco interactions without a match only pass a reco-driven
+     * selection in data (see @ref MatchTable), where their entry is kept so
+     * that the columns of a tree evaluated on the reco and on the matched
+     * true interactions stay aligned.
+     */
+    constexpr double kUnmatched = -1.0;
+
+    /**
+     * @struct MatchTable
+     * @brief Struct to store the reco-truth matching of the current spill.
+     * @details The best match of each interaction is the first entry of its
+     * match list, and an index of -1 indicates that the interaction has no
+     * match. The table is built once per spill (see @ref match_table()) and
+     * shared by all columns of all trees. The truth category of each true
+     * interaction is memoized per category cut (see @ref in_category()), so
+     * each category cut is evaluated at most once per true interaction. The
+     * memoized categories are recycled across spills like the Summaries.
+     */
+    struct MatchTable
+    {
+        bool valid = false;
+        std::vector<int64_t> reco_to_true; ///< Best match of each reco interaction.
+        std::vector<int64_t> true_to_reco; ///< Best match of each true interaction.
+        size_t used = 0;
+        std::deque<std::pair<const void *, std::vector<int8_t>>> categories; ///< Category (-1 if unevaluated) per cut.
+    };
+
+    /**
+     * @struct SummaryCache
+     * @brief Struct to store the Summary objects (and the MatchTable) of the
+     * current spill.
+     * @details The cache is keyed by the address of the interaction proxy,
+     * which is stable within a spill but reused across spills. The cache is
+     * therefore only active between calls to @ref enter_spill(), which resets
+     * it whenever a new spill index is seen, and @ref reset_spills(). The
+     * spill index is a running count of the spills of the sample (see
+     * ana::track_spills()), so it never repeats within a sample, and the
+     * cache is reset at the start and end of each sample. The entries are
+     * kept in a deque so that references to previously created entries
+     * remain valid, and they are recycled across spills to avoid
+     * reallocations.
+     */
+    struct SummaryCache
+    {
+        bool active = false;
+        uint64_t spill = 0;
+        size_t used = 0;
+        std::deque<std::pair<const void *, Summary>> entries;
+        MatchTable matches;
+    };
+
+    /**
+     * @brief Hand the contents of a reusable output buffer to the caller.
+     * @details The SpillMultiVar interface returns its result by value, so
+     * the filled buffer is moved into the result rather than copied, and
+     * the buffer is re-reserved with the size of the result so that the
+     * next spill is filled without growing it. An empty buffer keeps its
+     * capacity, so spills without entries do not allocate.
+     * @param buffer the (filled) output buffer.
+     * @return the contents of the buffer.
+     */
+    std::vector<double> release_buffer(std::vector<double> & buffer)
+    {
+        if(buffer.empty())
+            return std::vector<double>();
+        std::vector<double> result(std::move(buffer));
+        buffer.clear();
+        buffer.reserve(result.size());
+        return result;
+    }
+
+    /**
+     * @brief Retrieve the (thread-local) Summary cache.
+     * @details The cache is thread-local so that samples running concurrently
+     * with the parallel mode of the Analysis class never share it.
+     * @return the Summary cache of the calling thread.
+     */
+    SummaryCache & summary_cache()
+    {
+        thread_local SummaryCache cache;
+        return cache;
+    }
+
+    /**
+     * @brief Invalidate the contents of the Summary cache.
+     * @param cache the Summary cache to invalidate.
+     * @return void
+     */
+    void clear_summary_cache(SummaryCache & cache)
+    {
+        cache.used = 0;
+        cache.matches.valid = false;
+        cache.matches.used = 0;
+    }
+
+    /**
+     * @brief Signal the start of the processing of a spill.
+     * @details This function activates the Summary cache and invalidates its
+     * contents if the spill index differs from the one last seen on this
+     * thread. It is cheap to call repeatedly for the same spill, and is
+     * called by the first column of each Tree of the Analysis class (see
+     * ana::track_spills()).
+     * @param spill the (non-zero) index of the spill within the sample.
+     * @return void
+     */
+    void enter_spill(uint64_t spill)
+    {
+        SummaryCache & cache(summary_cache());
+        if(!cache.active || cache.spill != spill)
+        {
+            cache.active = true;
+            cache.spill = spill;
+            clear_summary_cache(cache);
+        }
+    }
+
+    /**
+     * @brief Deactivate and invalidate the Summary cache.
+     * @details This function must be called at the start of each sample, so
+     * that the spill indices of the sample are not confused with those of
+     * a previous sample processed on the same thread.
+     * @return void
+     */
+    void reset_spills()
+    {
+        SummaryCache & cache(summary_cache());
+        cache.active = false;
+        cache.spill = 0;
+        clear_summary_cache(cache);
+    }
+
+    /**
+     * @brief Retrieve the index of the current spill.
+     * @details The index is used by the per-spill caches of the selections
+     * of the Analysis class to detect a new spill.
+     * @return the index of the current spill, or 0 if no spill is active.
+     */
+    uint64_t current_spill()
+    {
+        const SummaryCache & cache(summary_cache());
+        return cache.active ? cache.spill : 0;
+    }
+
+    /**
+     * @brief Retrieve the MatchTable of a spill.
+     * @details The table is built on the first call in the spill. If no
+     * spill is active (see @ref enter_spill()), the table is rebuilt on each
+     * call.
+     * @tparam T the type of spill.
+     * @param sr the spill that is being processed.
+     * @return the MatchTable of the spill.
+     */
+    template<class T>
+        const MatchTable & match_table(const T * sr)
+        {
+            SummaryCache & cache(summary_cache());
+            MatchTable & m(cache.matches);
+            if(!m.valid || !cache.active)
+            {
+                m.reco_to_true.resize(sr->dlp.size());
+                for(size_t i(0); i < sr->dlp.size(); ++i)
+                    m.reco_to_true[i] = sr->dlp[i].match.size() > 0 ? int64_t(sr->dlp[i].match[0]) : int64_t(-1);
+                m.true_to_reco.resize(sr->dlp_true.size());
+                for(size_t i(0); i < sr->dlp_true.size(); ++i)
+                    m.true_to_reco[i] = sr->dlp_true[i].match.size() > 0 ? int64_t(sr->dlp_true[i].match[0]) : int64_t(-1);
+                m.valid = cache.active;
+                m.used = 0;
+            }
+            return m;
+        }
+
+    /**
+     * @brief Check if a true interaction of the spill belongs to a truth
+     * category.
+     * @details The category cut is evaluated on the first check of the true
+     * interaction in the spill, and memoized (keyed by the address of the cut)
+     * for all subsequent checks by any column. The MatchTable of the spill
+     * must have been retrieved (see @ref match_table()) first. If no spill is
+     * active, the cut is evaluated on each check.
+     * @tparam U the type of true interaction (must be given explicitly, so
+     * that templated cuts may be passed).
+     * @tparam T the type of spill.
+     * @param sr the spill that is being processed.
+     * @param t the index of the true interaction (-1 if none).
+     * @param cut the category cut.
+     * @return true if the true interaction exists and passes the cut.
+     */
+    template<class U, class T>
+        bool in_category(const T * sr, int64_t t, bool (*cut)(const U &))
+        {
+            if(t < 0)
+                return false;
+            SummaryCache & cache(summary_cache());
+            if(!cache.active)
+                return cut(sr->dlp_true[t]);
+            MatchTable & m(cache.matches);
+            const void * key(reinterpret_cast<const void *>(cut));
+            size_t c(0);
+            while(c < m.used && m.categories[c].first != key)
+                ++c;
+            if(c == m.used)
+            {
+                if(m.used == m.categories.size())
+                    m.categories.emplace_back();
+                m.categories[c].first = key;
+                m.categories[c].second.assign(sr->dlp_true.size(), -1);
+                ++m.used;
+            }
+            int8_t & pass(m.categories[c].second[t]);
+            if(pass < 0)
+                pass = cut(sr->dlp_true[t]);
+            return pass;
+        }
+
+    /**
+     * @brief Check if a true interaction of the spill belongs to a truth
+     * category given by an arbitrary callable.
+     * @details The memo of the categories is keyed by the address of the
+     * cut, which only identifies plain functions. Callables that convert to
+     * a function pointer (e.g. lambdas without captures) are therefore
+     * memoized as such, while any other callable (e.g. a lambda with
+     * captures, a std::function, or a functor) is evaluated on each check.
+     * @tparam U the type of true interaction (must be given explicitly).
+     * @tparam T the type of spill.
+     * @tparam C the type of the category cut.
+     * @param sr the spill that is being processed.
+     * @param t the index of the true interaction (-1 if none).
+     * @param cut the category cut.
+     * @return true if the true interaction exists and passes the cut.
+     */
+    template<class U, class T, class C>
+        bool in_category(const T * sr, int64_t t, const C & cut)
+        {
+            if constexpr (std::is_convertible_v<const C &, bool (*)(const U &)>)
+                return in_category<U, T>(sr, t, static_cast<bool (*)(const U &)>(cut));
+            else
+                return t >= 0 && cut(sr->dlp_true[t]);
+        }
+
+    /**
+     * @brief Fill the Summary of an interaction with a single loop over its
+     * particles.
+     * @details The leading particle is defined as the particle with the
+     * highest kinetic energy. If the interaction is a true interaction, the
+     * initial kinetic energy is used instead of the CSDA kinetic energy. The
+     * arrays of the Summary are resized rather than reallocated, so a
+     * recycled Summary keeps its capacity.
+     * @tparam T the type of interaction (true or reco).
+     * @param obj the interaction to summarize.
+     * @param s the Summary to fill.
+     * @return void
+     */
+    template<class T>
+        void fill_summary(const T & obj, Summary & s)
+        {
+            constexpr bool is_truth(std::is_same_v<T, caf::SRInteractionTruthDLPProxy>);
+            size_t n(obj.particles.size());
+            s.counts.fill(0);
+            s.leading.fill(0);
+            s.energy.resize(n);
+            s.signal.resize(n);
+            s.pid.resize(n);
+            s.primary.resize(n);
+            for(size_t k(0); k < 3; ++k)
+            {
+                s.momentum[k].resize(n);
+                s.start_dir[k].resize(n);
+                s.end_point[k].resize(n);
+            }
+            std::array<double, 5> leading_ke;
+            leading_ke.fill(0);
+            for(size_t i(0); i < n; ++i)
+            {
+                const auto & p = obj.particles[i];
+                size_t pid(p.pid);
+                s.energy[i] = pvars::energy(p);
+                s.signal[i] = pcuts::final_state_signal(p);
+                s.pid[i] = p.pid;
+                s.primary[i] = p.is_primary;
+                for(size_t k(0); k < 3; ++k)
+                {
+                    if constexpr (is_truth)
+                    {
+                        s.momentum[k][i] = p.truth_momentum[k];
+                        s.start_dir[k][i] = p.truth_start_dir[k];
+                    }
+                    else
+                    {
+                        s.momentum[k][i] = p.momentum[k];
+                        s.start_dir[k][i] = p.start_dir[k];
+                    }
+                    s.end_point[k][i] = p.end_point[k];
+                }
+                if(pid >= 5)
+                    continue;
+                if(s.signal[i])
+                    ++s.counts[pid];
+                double ke(p.csda_ke);
+                if constexpr (is_truth)
+                    ke = pvars::ke_init(p);
+                if(ke > leading_ke[pid])
+                {
+                    leading_ke[pid] = ke;
+                    s.leading[pid] = i;
+                }
+            }
+        }
+
+    /**
+     * @brief Retrieve the Summary of an interaction.
+     * @details The Summary is built once per interaction per spill and cached
+     * for subsequent calls. If no spill is active (see @ref enter_spill()),
+     * the Summary is rebuilt on each call and the returned reference is only
+     * valid until the next call.
+     * @tparam T the type of interaction (true or reco).
+     * @param obj the interaction to summarize.
+     * @return the Summary of the interaction.
+     */
+    template<class T>
+        const Summary & summarize(const T & obj)
+        {
+            SummaryCache & cache(summary_cache());
+            const void * key(&obj);
+            if(cache.active)
+            {
+                for(size_t i(0); i < cache.used; ++i)
+                    if(cache.entries[i].first == key)
+                        return cache.entries[i].second;
+            }
+            else cache.used = 0;
+
+            if(cache.used == cache.entries.size())
+                cache.entries.emplace_back();
+            std::pair<const void *, Summary> & entry(cache.entries[cache.used]);
+            if(cache.active)
+                ++cache.used;
+            entry.first = key;
+            fill_summary(obj, entry.second);
+            return entry.second;
+        }
+
     /**
      * @brief Count the primaries of the interaction with cuts applied to each particle.
+     * @details The counts are taken from the Summary of the interaction and
+     * returned as a fixed-size array, so no heap allocation is needed.
      * @tparam T the type of interaction (true or reco).
      * @param obj the interaction to find the topology of.
      * @return the count of primaries of each particle type within the
      * interaction.
      */
     template<class T>
-        std::vector<uint32_t> count_primaries(const T & obj)
+        std::array<uint32_t, 5> count_primaries(const T & obj)
         {
-            std::vector<uint32_t> counts(5, 0);
-            for(auto &p : obj.particles)
-            {
-                if(pcuts::final_state_signal(p))
-                    ++counts[p.pid];
-            }
-            return counts;
+            return summarize(obj).counts;
         }
     
     /**
@@ -56,7 +432,8 @@ namespace utilities
      * particle type.
      * @details The leading particle is defined as the particle with the highest
      * kinetic energy. If the interaction is a true interaction, the initial kinetic
-     * energy is used instead of the CSDA kinetic energy.
+     * energy is used instead of the CSDA kinetic energy. The index is taken from
+     * the Summary of the interaction.
      * @tparam T the type of interaction (true or reco).
      * @param obj the interaction to operate on.
      * @param pid of the particle type.
@@ -65,21 +442,7 @@ namespace utilities
     template <class T>
         size_t leading_particle_index(const T & obj, uint16_t pid)
         {
-            double leading_ke(0);
-            size_t index(0);
-            for(size_t i(0); i < obj.particles.size(); ++i)
-            {
-                const auto & p = obj.particles[i];
-                double energy(p.csda_ke);
-                if constexpr (std::is_same_v<T, caf::SRInteractionTruthDLPProxy>)
-                    energy = pvars::ke_init(p);
-                if(p.pid == pid && energy > leading_ke)
-                {
-                    leading_ke = energy;
-                    index = i;
-                }
-            }
-            return index;
+            return pid < 5 ? summarize(obj).leading[pid] : 0;
         }
 }
 #endif // UTILITIES_H
\ No newline at end of file
@@ -140,13 +140,14 @@ namespace vars
         double visible_energy(const T & obj)
         {
             double energy(0);
-            for(const auto & p : obj.particles)
+            const utilities::Summary & s(utilities::summarize(obj));
+            for(size_t i(0); i < s.energy.size(); ++i)
             {
-                if(p.is_primary)
+                if(s.primary[i])
                 {
-                    energy += pvars::energy(p);
-                    if(p.pid == 2) energy += MUON_MASS;
-                    else if(p.pid == 3) energy += PION_MASS;
+                    energy += s.energy[i];
+                    if(s.pid[i] == 2) energy += MUON_MASS;
+                    else if(s.pid[i] == 3) energy += PION_MASS;
                 }
             }
             return energy/1000.0;
@@ -253,8 +254,8 @@ namespace vars
     template<class T>
         double leading_muon_end_x(const T & obj)
         {
-            auto & m(obj.particles[utilities::leading_particle_index(obj, 2)]);
-            return m.end_point[0];
+            const utilities::Summary & s(utilities::summarize(obj));
+            return s.end_point[0][s.leading[2]];
         }
 
     /**
@@ -269,8 +270,8 @@ namespace vars
     template<class T>
         double leading_muon_end_y(const T & obj)
         {
-            auto & m(obj.particles[utilities::leading_particle_index(obj, 2)]);
-            return m.end_point[1];
+            const utilities::Summary & s(utilities::summarize(obj));
+            return s.end_point[1][s.leading[2]];
         }
 
     /**
@@ -285,8 +286,8 @@ namespace vars
     template<class T>
         double leading_muon_end_z(const T & obj)
         {
-            auto & m(obj.particles[utilities::leading_particle_index(obj, 2)]);
-            return m.end_point[2];
+            const utilities::Summary & s(utilities::summarize(obj));
+            return s.end_point[2][s.leading[2]];
         }
 
     /**
@@ -301,8 +302,8 @@ namespace vars
     template<class T>
         double leading_proton_end_x(const T & obj)
         {
-            auto & p(obj.particles[utilities::leading_particle_index(obj, 4)]);
-            return p.end_point[0];
+            const utilities::Summary & s(utilities::summarize(obj));
+            return s.end_point[0][s.leading[4]];
         }
 
     /**
@@ -317,8 +318,8 @@ namespace vars
     template<class T>
         double leading_proton_end_y(const T & obj)
         {
-            auto & p(obj.particles[utilities::leading_particle_index(obj, 4)]);
-            return p.end_point[1];
+            const utilities::Summary & s(utilities::summarize(obj));
+            return s.end_point[1][s.leading[4]];
         }
     
     /**
@@ -333,8 +334,8 @@ namespace vars
     template<class T>
         double leading_proton_end_z(const T & obj)
         {
-            auto & p(obj.particles[utilities::leading_particle_index(obj, 4)]);
-            return p.end_point[2];
+            const utilities::Summary & s(utilities::summarize(obj));
+            return s.end_point[2][s.leading[4]];
         }
 
     /**
@@ -399,7 +400,7 @@ namespace vars
         double leading_muon_ke(const T & obj)
         {
             size_t i(utilities::leading_particle_index(obj, 2));
-            double energy(pvars::energy(obj.particles[i]));
+            double energy(utilities::summarize(obj).energy[i]);
             if constexpr (std::is_same_v<T, caf::SRInteractionTruthDLPProxy>)
                 energy = pvars::ke_init(obj.particles[i]);
             return energy;
@@ -418,7 +419,7 @@ namespace vars
         double leading_proton_ke(const T & obj)
         {
             size_t i(utilities::leading_particle_index(obj, 4));
-            double energy(pvars::energy(obj.particles[i]));
+            double energy(utilities::summarize(obj).energy[i]);
             if constexpr (std::is_same_v<T, caf::SRInteractionTruthDLPProxy>)
                 energy = pvars::ke_init(obj.particles[i]);
             return energy;
@@ -438,8 +439,8 @@ namespace vars
     template<class T>
         double leading_muon_pt(const T & obj)
         {
-            size_t i(utilities::leading_particle_index(obj, 2));
-            return pvars::transverse_momentum(obj.particles[i]);
+            const utilities::Summary & s(utilities::summarize(obj));
+            return pvars::transverse_momentum(s, s.leading[2]);
         }
 
     /**
@@ -456,8 +457,8 @@ namespace vars
     template<class T>
         double leading_proton_pt(const T & obj)
         {
-            size_t i(utilities::leading_particle_index(obj, 4));
-            return pvars::transverse_momentum(obj.particles[i]);
+            const utilities::Summary & s(utilities::summarize(obj));
+            return pvars::transverse_momentum(s, s.leading[4]);
         }
 
     /**
@@ -472,8 +473,8 @@ namespace vars
     template<class T>
         double muon_polar_angle(const T & obj)
         {
-            size_t i(utilities::leading_particle_index(obj, 2));
-            return pvars::polar_angle(obj.particles[i]);
+            const utilities::Summary & s(utilities::summarize(obj));
+            return pvars::polar_angle(s, s.leading[2]);
         }
 
     /**
@@ -488,8 +489,8 @@ namespace vars
     template<class T>
         double muon_azimuthal_angle(const T & obj)
         {
-            size_t i(utilities::leading_particle_index(obj, 2));
-            return pvars::azimuthal_angle(obj.particles[i]);
+            const utilities::Summary & s(utilities::summarize(obj));
+            return pvars::azimuthal_angle(s, s.leading[2]);
         }
 
     /**
@@ -506,19 +507,12 @@ namespace vars
         double interaction_pt(const T & obj)
         {
             double px(0), py(0);
-            for(const auto & p : obj.particles)
-                if(p.is_primary)
+            const utilities::Summary & s(utilities::summarize(obj));
+            for(size_t i(0); i < s.primary.size(); ++i)
+                if(s.primary[i])
                 {
-                    if constexpr (std::is_same_v<T, caf::SRInteractionTruthDLPProxy>)
-                    {
-                        px += p.truth_momentum[0];
-                        py += p.truth_momentum[1];
-                    }
-                    else
-                    {
-                        px += p.momentum[0];
-                        py += p.momentum[1];
-                    }
+                    px += s.momentum[0][i];
+                    py += s.momentum[1][i];
                 }
             return std::sqrt(std::pow(px, 2) + std::pow(py, 2));
         }
@@ -536,34 +530,19 @@ namespace vars
         double phiT(const T & obj)
         {
             double lpx(0), lpy(0), hpx(0), hpy(0);
-            for(const auto & p : obj.particles)
-                if(pcuts::final_state_signal(p))
+            const utilities::Summary & s(utilities::summarize(obj));
+            for(size_t i(0); i < s.signal.size(); ++i)
+                if(s.signal[i])
                 {
-                    if(p.pid > 2)
+                    if(s.pid[i] > 2)
                     {
-                        if constexpr (std::is_same_v<T, caf::SRInteractionTruthDLPProxy>)
-                        {
-                            hpx += p.truth_momentum[0];
-                            hpy += p.truth_momentum[1];
-                        }
-                        else
-                        {
-                            hpx += p.momentum[0];
-                            hpy += p.momentum[1];
-                        }
+                        hpx += s.momentum[0][i];
+                        hpy += s.momentum[1][i];
                     }
-                    else if(p.pid == 2)
+                    else if(s.pid[i] == 2)
                     {
-                        if constexpr (std::is_same_v<T, caf::SRInteractionTruthDLPProxy>)
-                        {
-                            lpx += p.truth_momentum[0];
-                            lpy += p.truth_momentum[1];
-                        }
-                        else
-                        {
-                            lpx += p.momentum[0];
-                            lpy += p.momentum[1];
-                        }
+                        lpx += s.momentum[0][i];
+                        lpy += s.momentum[1][i];
                     }
                 }
             return std::acos((-hpx * lpx - hpy * lpy) / (std::sqrt(std::pow(hpx, 2) + std::pow(hpy, 2)) * std::sqrt(std::pow(lpx, 2) + std::pow(lpy, 2))));
@@ -581,32 +560,17 @@ namespace vars
         double alphaT(const T & obj)
         {
             double lpx(0), lpy(0), px(0), py(0);
-            for(const auto & p : obj.particles)
-                if(pcuts::final_state_signal(p))
+            const utilities::Summary & s(utilities::summarize(obj));
+            for(size_t i(0); i < s.signal.size(); ++i)
+                if(s.signal[i])
                 {
-                    if(p.pid <= 2)
-                    {
-                        if constexpr (std::is_same_v<T, caf::SRInteractionTruthDLPProxy>)
-                        {
-                            lpx += p.truth_momentum[0];
-                            lpy += p.truth_momentum[1];
-                        }
-                        else
-                        {
-                            lpx += p.momentum[0];
-                            lpy += p.momentum[1];
-                        }
-                    }
-                    if constexpr (std::is_same_v<T, caf::SRInteractionTruthDLPProxy>)
-                    {
-                        px += p.truth_momentum[0];
-                        py += p.truth_momentum[1];
-                    }
-                    else
+                    if(s.pid[i] <= 2)
                     {
-                        px += p.momentum[0];
-                        py += p.momentum[1];
+                        lpx += s.momentum[0][i];
+                        lpy += s.momentum[1][i];
                     }
+                    px += s.momentum[0][i];
+                    py += s.momentum[1][i];
                 }
             return std::acos((-px * lpx - py * lpy) / (std::sqrt(std::pow(px, 2) + std::pow(py, 2)) * std::sqrt(std::pow(lpx, 2) + std::pow(lpy, 2))));
         }
@@ -1,3 +1,7 @@
+import os
+import json
+import hashlib
+import numpy as np
 import toml
 import uproot
 from sample import Sample
@@ -25,6 +29,13 @@ class Analysis:
     _category_tree : str
         The label of the branch corresponding to the category label in
         the input TTree.
+    _cache_path : str
+        The path to the directory of the on-disk cache of the per-sample
+        histograms, configured with the 'histogram_cache' key of the
+        analysis table (or None if the cache is disabled).
+    _input_stamp : dict
+        The path, size, and modification time of the input ROOT file,
+        which are part of the key of the histogram cache.
     """
     def __init__(self, toml_path, rf_path) -> None:
         """
@@ -57,7 +68,21 @@ class Analysis:
         # Initialize the samples
         if 'samples' not in self._config.keys():
             raise ConfigException(f"No samples defined in the TOML file. Please check for a valid sample configuration block in the TOML file ('{toml_path}').")
-        self._samples = {name: Sample(name, rf, self._config['analysis']['category_branch'], **self._config['samples'][name]) for name in self._config['samples']}
+        # Read only the columns used by the variables from the columnar
+        # export of the ROOT file (written next to it), if it exists. Each
+        # sample checks that the stamp of its export matches the ROOT file.
+        columns_path = os.path.splitext(rf_path)[0] + '.columns'
+        columns_path = columns_path if os.path.isdir(columns_path) else None
+        columns = {v['key'] for v in self._config.get('variables', dict()).values()} | {self._config['analysis']['category_branch']}
+        chunk_size = self._config['analysis'].get('chunk_size', 500000)
+        self._samples = {name: Sample(name, rf, self._config['analysis']['category_branch'], **self._config['samples'][name], columns_path=columns_path, columns=columns, chunk_size=chunk_size) for name in self._config['samples']}
+
+        # The per-sample histograms are optionally cached in the
+        # configured directory, keyed by the configuration and the
+        # state of the ROOT file.
+        self._cache_path = self._config['analysis'].get('histogram_cache', None) or None
+        stat = os.stat(rf_path)
+        self._input_stamp = {'path': os.path.abspath(rf_path), 'size': stat.st_size, 'mtime': stat.st_mtime}
 
         # Load the plot styles table
         if 'styles' not in self._config.keys():
@@ -118,15 +143,134 @@ class Analysis:
         for s in self._samples.values():
             s.set_weight(target=ordinate)
 
-        for name, s in self._spectra.items():
-            for sample in self._samples.values():
-                s.add_sample(sample)
+        for sample_name, sample in self._samples.items():
+            hists = self.load_histograms(sample_name)
+            if hists is None:
+                hists = self.fill_histograms(sample)
+                self.save_histograms(sample_name, hists)
+            for name, s in self._spectra.items():
+                s.add_histograms(hists[name], sample.get_weight())
 
+        for name, s in self._spectra.items():
             with self._styles[s._style] as style:
                 s.plot(style, name)
                 if type(s) == SpineSpectra2D:
                     s.plot_diagonal_reduction(style, name)
 
+    def fill_histograms(self, sample) -> dict:
+        """
+        Fills the unweighted histograms of all spectra for a single
+        sample. The sample is read once, chunk-by-chunk, and only the
+        branches used by the spectra are read.
+
+        Parameters
+        ----------
+        sample : Sample
+            The sample to fill the histograms of.
+
+        Returns
+        -------
+        hists : dict
+            The unweighted histograms of each (input) category for each
+            spectrum, keyed by the name of the spectrum.
+        """
+        hists = {name: dict() for name in self._spectra.keys()}
+        keys = {k for s in self._spectra.values() for k in s.keys()}
+        for chunk in sample.iterate(keys):
+            for name, s in self._spectra.items():
+                s.fill(hists[name], sample.get_data(s.keys(), chunk)[0])
+        return hists
+
+    def cache_file(self, sample_name) -> str:
+        """
+        Returns the path of the cached histograms of a sample. The name
+        of the file contains a hash of the configuration of the sample,
+        the variables and categories of the spectra, and the state of
+        the input ROOT file, so that any change of these invalidates the
+        cache. The exposure weights are applied after the cache, so
+        they are not part of the hash.
+
+        Parameters
+        ----------
+        sample_name : str
+            The name of the sample.
+
+        Returns
+        -------
+        path : str
+            The path of the cached histograms of the sample.
+        """
+        key = {
+            'input': self._input_stamp,
+            'sample': self._config['samples'][sample_name],
+            'category_branch': self._config['analysis']['category_branch'],
+            'categories': sorted(self._categories.keys()),
+            'spectra': {name: [type(s).__name__] + [[v._key, list(v._range), v._nbins] for v in s._variables] for name, s in self._spectra.items()},
+        }
+        digest = hashlib.sha256(json.dumps(key, sort_keys=True, default=str).encode()).hexdigest()[:16]
+        return f'{self._cache_path}/{sample_name}_{digest}.npz'
+
+    def load_histograms(self, sample_name):
+        """
+        Loads the cached histograms of a sample, if they exist.
+
+        Parameters
+        ----------
+        sample_name : str
+            The name of the sample.
+
+        Returns
+        -------
+        hists : dict
+            The unweighted histograms of each (input) category for each
+            spectrum (see fill_histograms()), or None if the histograms
+            are not cached (or the cache can not be read).
+        """
+        if self._cache_path is None or not os.path.exists(self.cache_file(sample_name)):
+            return None
+        hists = {name: dict() for name in self._spectra.keys()}
+        try:
+            with np.load(self.cache_file(sample_name)) as f:
+                for k in f.files:
+                    name, category, i = k.rsplit('|', 2)
+                    hists[name].setdefault(int(category), dict())[int(i)] = f[k]
+        except (OSError, ValueError, KeyError) as e:
+            print(f"Ignoring unreadable histogram cache for {sample_name}: {e}")
+            return None
+        for name in hists.keys():
+            hists[name] = {c: [h[i] for i in sorted(h.keys())] for c, h in hists[name].items()}
+        print(f"Loaded cached histograms for {sample_name}")
+        return hists
+
+    def save_histograms(self, sample_name, hists) -> None:
+        """
+        Saves the histograms of a sample to the cache (if enabled). A
+        cache that can not be written (e.g. a read-only directory) is
+        reported and otherwise ignored.
+
+        Parameters
+        ----------
+        sample_name : str
+            The name of the sample.
+        hists : dict
+            The unweighted histograms of each (input) category for each
+            spectrum (see fill_histograms()).
+
+        Returns
+        -------
+        None.
+        """
+        if self._cache_path is None:
+            return
+        arrays = {f'{name}|{category}|{i}': h for name, c in hists.items() for category, hs in c.items() for i, h in enumerate(hs)}
+        path = self.cache_file(sample_name)
+        try:
+            os.makedirs(self._cache_path, exist_ok=True)
+            np.savez(f'{path[:-4]}.tmp.npz', **arrays)
+            os.replace(f'{path[:-4]}.tmp.npz', path)
+        except OSError as e:
+            print(f"Failed to write histogram cache for {sample_name}: {e}")
+
     @classmethod
     def handle_include(self, config, table):
         """
@@ -1,3 +1,4 @@
+import os
 import numpy as np
 import pandas as pd
 
@@ -22,10 +23,20 @@ class Sample:
     _category_branch : str
         The name of the branch in the TTree containing the category
         labels.
-    _data : pd.DataFrame
-        The data comprising the sample.
+    _override_category : int
+        The category to override the category branch with (or None).
+    _trees : list
+        The list of TTree names in the ROOT file comprising the sample.
+    _columns_path : str
+        The path to the columnar export of the sample (or None).
+    _columns : set[str]
+        The names of the columns projected by default.
+    _chunk_size : int
+        The number of entries per chunk.
+    _weight : float
+        The weight of each entry of the sample.
     """
-    def __init__(self, name, rf, category_branch, key, scaling_type, trees, override_category=None) -> None:
+    def __init__(self, name, rf, category_branch, key, scaling_type, trees, override_category=None, columns_path=None, columns=None, chunk_size=500000) -> None:
         """
         Initializes the Sample object with the given name and key.
 
@@ -53,6 +64,19 @@ class Sample:
         override_category : int
             The category to override the category branch with if it is
             configured. Else, the category branch is left as is.
+        columns_path : str
+            The path to the (optional) columnar export of the ROOT file
+            written by the CAFAna Analysis class. If the export contains
+            the sample and its stamp matches the one stored in the sample
+            directory of the ROOT file (see columns_stamp_matches()), the
+            requested columns are read from the export instead of the
+            TTrees.
+        columns : set[str]
+            The names of the columns to read by default. If None, all
+            branches of the TTrees are read.
+        chunk_size : int
+            The number of entries per chunk when iterating over the
+            sample (see iterate()).
 
         Returns
         -------
@@ -64,12 +88,143 @@ class Sample:
         self._exposure_pot = self._file_handle['POT'].to_numpy()[0][0]
         self._exposure_livetime = self._file_handle['Livetime'].to_numpy()[0][0]
         self._category_branch = category_branch
+        self._override_category = override_category
+        self._trees = trees
+        self._columns_path = f'{columns_path}/{key}' if columns_path is not None and Sample.columns_stamp_matches(self._file_handle, f'{columns_path}/{key}') else None
+        self._columns = columns
+        self._chunk_size = chunk_size
+        self._weight = 1
 
-        self._data = pd.concat([self._file_handle[tree].arrays(library='pd') for tree in trees])
-        if self._category_branch not in self._data.columns:
-            self._data[self._category_branch] = 0
-        if override_category is not None:
-            self._data[self._category_branch] = override_category
+    @staticmethod
+    def columns_stamp_matches(directory, path) -> bool:
+        """
+        Checks whether the columnar export of a sample belongs to the
+        sample directory of the ROOT file. The CAFAna Analysis class
+        writes the same stamp to the export ('<path>/stamp') and to the
+        'columns' TNamed of the sample directory each time the sample
+        is written, so an export left over from an earlier run (or a
+        sample rewritten without an export) does not match.
+
+        Parameters
+        ----------
+        directory : uproot.reading.ReadOnlyDirectory
+            The sample directory of the ROOT file.
+        path : str
+            The directory of the columnar export of the sample.
+
+        Returns
+        -------
+        bool
+            True if the export exists and its stamp matches.
+        """
+        if not os.path.isfile(f'{path}/stamp') or 'columns' not in directory.keys(cycle=False):
+            return False
+        with open(f'{path}/stamp') as f:
+            stamp = f.readline().strip()
+        return stamp != '' and stamp == directory['columns'].member('fTitle')
+
+    def iterate(self, columns=None):
+        """
+        Iterates over the entries of the sample in chunks of at most
+        `chunk_size` entries. Only the requested columns (and the
+        category branch) are read, either from the columnar export or
+        from the TTrees, so that the sample is never held in memory as
+        a whole. The category branch is set to zero if it is missing
+        and to the override category if one is configured.
+
+        Parameters
+        ----------
+        columns : set[str]
+            The names of the columns to read. If None, the default
+            columns of the sample are read.
+
+        Yields
+        ------
+        data : pd.DataFrame
+            The requested columns of the next chunk of entries.
+        """
+        columns = self._columns if columns is None else set(columns)
+        if columns is not None:
+            columns = set(columns) | {self._category_branch}
+        for tree in self._trees:
+            if self._columns_path is not None:
+                chunks = Sample.iterate_columns(f'{self._columns_path}/{tree}', columns, self._chunk_size)
+            else:
+                chunks = self.iterate_tree(tree, columns)
+            for data in chunks:
+                if self._category_branch not in data.columns:
+                    data[self._category_branch] = 0
+                if self._override_category is not None:
+                    data[self._category_branch] = self._override_category
+                yield data
+
+    def iterate_tree(self, tree, columns):
+        """
+        Iterates over a single tree of the sample in the ROOT file,
+        reading only the requested branches. If the tree has a friend
+        tree (written by the friend mode of the CAFAna Analysis class),
+        the requested branches of the friend tree are read in the same
+        chunks and appended entry-by-entry.
+
+        Parameters
+        ----------
+        tree : str
+            The name of the tree to iterate over.
+        columns : set[str]
+            The names of the columns to read. If None, all branches
+            are read.
+
+        Yields
+        ------
+        data : pd.DataFrame
+            The requested columns of the next chunk of entries.
+        """
+        handles = [self._file_handle[tree]]
+        if f'{tree}_friend' in self._file_handle:
+            handles.append(self._file_handle[f'{tree}_friend'])
+        iterators = list()
+        for h in handles:
+            branches = [b for b in h.keys() if columns is None or b in columns]
+            if branches:
+                iterators.append(h.iterate(branches, step_size=self._chunk_size, library='pd'))
+        if not iterators:
+            return
+        for chunks in zip(*iterators):
+            yield pd.concat([c.reset_index(drop=True) for c in chunks], axis=1)
+
+    @staticmethod
+    def iterate_columns(path, columns, chunk_size):
+        """
+        Iterates over the requested columns of a single tree in the
+        columnar export. Each column is stored as a NumPy (.npy) file,
+        which is memory-mapped so that only the requested columns (and
+        only the entries of the current chunk) are read. Columns that
+        are not present in the export are skipped.
+
+        Parameters
+        ----------
+        path : str
+            The path to the directory of the tree in the columnar
+            export.
+        columns : set[str]
+            The names of the columns to read. If None, all columns of
+            the export are read.
+        chunk_size : int
+            The number of entries per chunk.
+
+        Yields
+        ------
+        data : pd.DataFrame
+            The requested columns of the next chunk of entries.
+        """
+        if columns is None:
+            columns = {os.path.splitext(f)[0] for f in os.listdir(path) if f.endswith('.npy')}
+        arrays = {c: np.load(f'{path}/{c}.npy', mmap_mode='r') for c in columns if os.path.exists(f'{path}/{c}.npy')}
+        if not arrays:
+            return
+        n = len(next(iter(arrays.values())))
+        for start in range(0, n, chunk_size):
+            yield pd.DataFrame({c: np.asarray(a[start:start+chunk_size]) for c, a in arrays.items()})
 
     def override_exposure(self, exposure, exposure_type='pot') -> None:
         """
@@ -98,7 +253,9 @@ class Sample:
 
     def set_weight(self, target=None) -> None:
         """
-        Sets the weight for the sample to the target value.
+        Sets the weight for the sample to the target value. The weight
+        is the same for all entries of the sample, so it is stored as a
+        single value and applied to the histograms of the sample.
 
         Parameters
         ----------
@@ -112,24 +269,44 @@ class Sample:
         None.
         """
         if target is None:
-            self._data['weight'] = 1
+            self._weight = 1
         elif self._scaling_type == 'pot':
-            self._data['weight'] = (target._exposure_pot / self._exposure_pot)
+            self._weight = (target._exposure_pot / self._exposure_pot)
             print(f"Setting weight for {self._name} to {target._exposure_pot / self._exposure_pot:.2e}")
         else:
-            self._data['weight'] = (target._exposure_livetime / self._exposure_livetime)
+            self._weight = (target._exposure_livetime / self._exposure_livetime)
             print(f"Setting weight for {self._name} to {target._exposure_livetime / self._exposure_livetime:.2e}")
 
-    def get_data(self, variables) -> dict:
+    def get_weight(self) -> float:
+        """
+        Returns the weight of each entry of the sample.
+
+        Parameters
+        ----------
+        None.
+
+        Returns
+        -------
+        weight : float
+            The weight of each entry of the sample.
+        """
+        return self._weight
+
+    def get_data(self, variables, chunk=None) -> dict:
         """
         Returns the data for the given variable(s) in the sample. The
         data is returned as a dictionary with the category as the key
-        and the data for the requested variable as the value.
+        and the data for the requested variable as the value. If no
+        chunk is given, only the requested variables of the whole
+        sample are loaded.
 
         Parameters
         ----------
         variables : list[str]
             The names of the variables to retrieve.
+        chunk : pd.DataFrame
+            The chunk of entries (see iterate()) to retrieve the data
+            from. If None, the data of the whole sample is retrieved.
 
         Returns
         -------
@@ -142,13 +319,14 @@ class Sample:
             weights are stored as a dictionary with the category as the
             key and the weights (a pandas Series) as the value.
         """
+        if chunk is None:
+            chunks = list(self.iterate(variables))
+            chunk = pd.concat(chunks, ignore_index=True) if chunks else pd.DataFrame(columns=list(variables) + [self._category_branch])
         data = {}
         weights = {}
-        for category in np.unique(self._data[self._category_branch]):
-            data[int(category)] = list()
-            for v in variables:
-                data[int(category)].append(self._data[self._data[self._category_branch] == category][v])    
-            weights[int(category)] = self._data[self._data[self._category_branch] == category]['weight']
+        for category, group in chunk.groupby(self._category_branch):
+            data[int(category)] = [group[v] for v in variables]
+            weights[int(category)] = pd.Series(self._weight, index=group.index)
         return data, weights
 
     def __str__(self) -> str:
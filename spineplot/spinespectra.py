@@ -62,11 +62,50 @@ class SpineSpectra:
         self._colors = colors
         self._plotdata = None
 
+    def keys(self) -> list:
+        """
+        Returns the keys of the branches read by the spectra.
+
+        Parameters
+        ----------
+        None.
+
+        Returns
+        -------
+        keys : list[str]
+            The keys of the branches of the variables of the spectra.
+        """
+        return [v._key for v in self._variables]
+
+    @staticmethod
+    def accumulate(hists, category, h) -> None:
+        """
+        Accumulates the histograms of a single category.
+
+        Parameters
+        ----------
+        hists : dict
+            The unweighted histograms of each (input) category, stored
+            as a list of arrays.
+        category : int
+            The category of the histograms.
+        h : list[np.ndarray]
+            The histograms to add.
+
+        Returns
+        -------
+        None.
+        """
+        if category in hists:
+            hists[category] = [a + b for a, b in zip(hists[category], h)]
+        else:
+            hists[category] = list(h)
+
 class SpineSpectra1D(SpineSpectra):
     """
     A class designed to encapsulate a single variable's spectrum for an
-    ensemble of samples. The class method add_sample() can be used to
-    add a sample to the SpineSpectra
+    ensemble of samples. The histograms of each sample are filled with
+    fill() and added to the SpineSpectra1D with add_histograms().
 
     Attributes
     ----------
@@ -130,36 +169,56 @@ class SpineSpectra1D(SpineSpectra):
         self._plotdata = None
         self._binedges = None
 
-    def add_sample(self, sample) -> None:
+    def fill(self, hists, data) -> None:
         """
-        Adds a sample to the SpineSpectra1D object. The sample's data
-        is extracted per category and stored for later plotting.
-        Multiple samples may have overlapping categories, so the data
-        is stored in a dictionary with the category as the key.
+        Fills the unweighted histograms of a chunk of a sample.
 
         Parameters
         ----------
-        sample : Sample
-            The sample to add to the SpineSpectra1D object.
+        hists : dict
+            The unweighted histograms of each (input) category.
+        data : dict
+            The data of the chunk for each category (see
+            Sample.get_data()).
 
         Returns
         -------
         None.
         """
+        for category, values in data.items():
+            if category not in self._categories.keys():
+                continue
+            h = np.histogram(values[0], bins=self._variable._nbins, range=self._variable._range)
+            SpineSpectra.accumulate(hists, category, [h[0]])
 
+    def add_histograms(self, hists, weight) -> None:
+        """
+        Adds the unweighted histograms of a sample to the
+        SpineSpectra1D object. Multiple samples may have overlapping
+        categories, so the data is stored in a dictionary with the
+        category as the key.
+
+        Parameters
+        ----------
+        hists : dict
+            The unweighted histograms of each (input) category.
+        weight : float
+            The weight of the sample.
+
+        Returns
+        -------
+        None.
+        """
         if self._plotdata is None:
             self._plotdata = {}
             self._binedges = {}
-        data, weights = sample.get_data([self._variable._key,])
-        for category, values in data.items():
-            values = values[0]
+        for category, h in hists.items():
             if category not in self._categories.keys():
                 continue
             if self._categories[category] not in self._plotdata:
                 self._plotdata[self._categories[category]] = np.zeros(self._variable._nbins)
-            h = np.histogram(values, bins=self._variable._nbins, range=self._variable._range, weights=weights[category])
-            self._plotdata[self._categories[category]] += h[0]
-            self._binedges[self._categories[category]] = h[1]
+            self._plotdata[self._categories[category]] += weight * h[0]
+            self._binedges[self._categories[category]] = np.histogram_bin_edges([], bins=self._variable._nbins, range=self._variable._range)
 
     def plot(self, style, name) -> None:
         """
@@ -211,8 +270,8 @@ class SpineSpectra1D(SpineSpectra):
 class SpineSpectra2D(SpineSpectra):
     """
     A class designed to encapsulate a pair of variables' spectrum for
-    an ensemble of samples. The class method add_sample() can be used
-    to add a sample to the SpineSpectra2D.
+    an ensemble of samples. The histograms of each sample are filled
+    with fill() and added to the SpineSpectra2D with add_histograms().
 
     Attributes
     ----------
@@ -276,17 +335,44 @@ class SpineSpectra2D(SpineSpectra):
         self._plotdata_diagonal = None
         self._binedges_diagonal = None
 
-    def add_sample(self, sample) -> None:
+    def fill(self, hists, data) -> None:
         """
-        Adds a sample to the SpineSpectra2D object. The sample's data
-        is extracted per category and stored for later plotting.
-        Multiple samples may have overlapping categories, so the data
-        is stored in a dictionary with the category as the key.
+        Fills the unweighted histograms (the 2D histogram and its
+        diagonal reduction) of a chunk of a sample.
 
         Parameters
         ----------
-        sample : Sample
-            The sample to add to the SpineSpectra2D object.
+        hists : dict
+            The unweighted histograms of each (input) category.
+        data : dict
+            The data of the chunk for each category (see
+            Sample.get_data()).
+
+        Returns
+        -------
+        None.
+        """
+        for category, values in data.items():
+            if category not in self._categories.keys():
+                continue
+            h = np.histogram2d(values[0], values[1], bins=(self._variables[0]._nbins, self._variables[1]._nbins), range=(self._variables[0]._range, self._variables[1]._range))
+            diag = np.divide(values[1] - values[0], values[0])#, where=values[0] != 0)
+            hd = np.histogram(diag, bins=self._variables[0]._nbins, range=(-4,4))
+            SpineSpectra.accumulate(hists, category, [h[0], hd[0]])
+
+    def add_histograms(self, hists, weight) -> None:
+        """
+        Adds the unweighted histograms of a sample to the
+        SpineSpectra2D object. Multiple samples may have overlapping
+        categories, so the data is stored in a dictionary with the
+        category as the key.
+
+        Parameters
+        ----------
+        hists : dict
+            The unweighted histograms of each (input) category.
+        weight : float
+            The weight of the sample.
 
         Returns
         -------
@@ -299,23 +385,19 @@ class SpineSpectra2D(SpineSpectra):
             self._plotdata_diagonal = {}
             self._binedges_diagonal = {}
 
-        data, weights = sample.get_data([self._variables[0]._key, self._variables[1]._key])        
-        for category, values in data.items():
+        for category, h in hists.items():
             if category not in self._categories.keys():
                 continue
             if self._categories[category] not in self._plotdata:
                 self._plotdata[self._categories[category]] = np.zeros((self._variables[0]._nbins, self._variables[1]._nbins))
-            h = np.histogram2d(values[0], values[1], bins=(self._variables[0]._nbins, self._variables[1]._nbins), range=(self._variables[0]._range, self._variables[1]._range), weights=weights[category])
-            self._plotdata[self._categories[category]] += h[0]
-            self._binedges[self._categories[category]] = h[1]
+            self._plotdata[self._categories[category]] += weight * h[0]
+            self._binedges[self._categories[category]] = np.histogram_bin_edges([], bins=self._variables[0]._nbins, range=self._variables[0]._range)
 
             if self._categories[category] not in self._plotdata_diagonal:
                 self._plotdata_diagonal[self._categories[category]] = np.zeros(self._variables[0]._nbins)
-            diag = np.divide(values[1] - values[0], values[0])#, where=values[0] != 0)
-            h = np.histogram(diag, bins=self._variables[0]._nbins, range=(-4,4), weights=weights[category])
-            self._plotdata_diagonal[self._categories[category]] += h[0]
-            self._binedges_diagonal[self._categories[category]] = h[1]
-        
+            self._plotdata_diagonal[self._categories[category]] += weight * h[1]
+            self._binedges_diagonal[self._categories[category]] = np.histogram_bin_edges([], bins=self._variables[0]._nbins, range=(-4,4))
+
 
     def plot(self, style, name) -> None:
         """
@@ -11,6 +11,9 @@
  */
 #ifndef CONFIGURATION_H
 #define CONFIGURATION_H
+#include <map>
+#include <string>
+#include <vector>
 #include <toml++/toml.h>
 
 /**
@@ -55,6 +58,52 @@ namespace sys::cfg
         std::string message; ///< The error message.
     };
 
+    /**
+     * @struct SystematicConfig
+     * @brief Struct storing the definition of a single systematic parameter.
+     * @details This struct is resolved once from an element of a systematic
+     * table list (e.g. [[multisim]]) in the configuration file.
+     */
+    struct SystematicConfig
+    {
+        std::string name; ///< The name of the systematic parameter.
+        int64_t index; ///< The index of the parameter within the CAF weights.
+    };
+
+    /**
+     * @struct TreeConfig
+     * @brief Struct storing the configuration of a single [[tree]] entry.
+     * @details This struct is resolved once from a [[tree]] table in the
+     * configuration file. Fields that do not apply to the action of the tree
+     * are left empty.
+     */
+    struct TreeConfig
+    {
+        std::string action; ///< The action ("copy", "add_weights", "histogram", or "covariance").
+        std::string origin; ///< The path of the input TTree.
+        std::string destination; ///< The output directory.
+        std::string name; ///< The name of the output object(s).
+        std::string mode; ///< The copy mode ("fast" or "typed").
+        std::vector<std::string> tables; ///< The names of the systematic tables.
+        std::string format; ///< The weight format ("vector" or "flat").
+        std::string variable; ///< The histogrammed variable.
+        std::vector<double> bins; ///< The bin edges of the variable.
+        std::vector<std::string> sigma_tables; ///< The systematic tables of multisigma parameters (covariance only).
+        std::vector<double> sigmas; ///< The shift (in standard deviations) of each universe of the multisigma parameters.
+    };
+
+    /**
+     * @struct JobConfig
+     * @brief Struct storing the global (input/output) configuration.
+     */
+    struct JobConfig
+    {
+        std::string input_path; ///< The path of the input ROOT file.
+        std::string output_path; ///< The path of the output ROOT file.
+        std::string caflist; ///< The path of the list of CAF files.
+        int64_t nthreads; ///< The number of workers processing CAF files.
+    };
+
     class ConfigurationTable
     {
     public:
@@ -114,6 +163,20 @@ namespace sys::cfg
          */
         std::string get_string_field(const std::string & field);
 
+        /**
+         * @brief Get the requested string field from the ConfigurationTable,
+         * or a default value if the field is not present.
+         * @details This function gets the requested string field from the
+         * ConfigurationTable. If the field is not present, the function
+         * returns the provided default value. This is used for optional
+         * fields of the configuration file.
+         * @param field The name of the field that is requested.
+         * @param default_value The value returned if the field is not present.
+         * @return The value of the requested string field.
+         * @throw None
+         */
+        std::string get_string_field(const std::string & field, const std::string & default_value);
+
         /**
          * @brief Get a list of all strings matching the requested field name.
          * @details This function gets a list of all strings matching the requested
@@ -124,6 +187,17 @@ namespace sys::cfg
          */
         std::vector<std::string> get_string_vector(const std::string & field);
 
+        /**
+         * @brief Get a list of all numbers matching the requested field name.
+         * @details This function gets a list of all numbers matching the
+         * requested field name. Integer elements are converted to doubles.
+         * The function returns a vector of doubles.
+         * @param field The field that is requested.
+         * @return A vector of doubles.
+         * @throw ConfigurationError
+         */
+        std::vector<double> get_double_vector(const std::string & field);
+
         /**
          * @brief Get the requested integer field from the ConfigurationTable.
          * @details This function gets the requested integer field from the
@@ -135,6 +209,20 @@ namespace sys::cfg
          */
         int64_t get_int_field(const std::string & field);
 
+        /**
+         * @brief Get the requested integer field from the ConfigurationTable,
+         * or a default value if the field is not present.
+         * @details This function gets the requested integer field from the
+         * ConfigurationTable. If the field is not present, the function
+         * returns the provided default value. This is used for optional
+         * fields of the configuration file.
+         * @param field The name of the field that is requested.
+         * @param default_value The value returned if the field is not present.
+         * @return The value of the requested integer field.
+         * @throw None
+         */
+        int64_t get_int_field(const std::string & field, int64_t default_value);
+
         /**
          * @brief Get a list of all subtables matching the requested table name.
          * @details This function gets a list of all subtables matching the
@@ -146,14 +234,48 @@ namespace sys::cfg
          * @see ConfigurationTable
          */
         std::vector<ConfigurationTable> get_subtables(const std::string & table);
+
+        /**
+         * @brief Get the global (input/output) configuration.
+         * @details The configuration is resolved once when the configuration
+         * file is loaded.
+         * @return The global configuration.
+         * @throw None
+         */
+        const JobConfig & get_job() const { return job; }
+
+        /**
+         * @brief Get the configuration of all [[tree]] entries.
+         * @details The configuration is resolved (and validated) once when
+         * the configuration file is loaded.
+         * @return The configuration of each tree, in the order of the file.
+         * @throw None
+         */
+        const std::vector<TreeConfig> & get_trees() const { return trees; }
+
+        /**
+         * @brief Get the systematic parameters of a systematic table.
+         * @details The systematic tables referenced by any [[tree]] entry are
+         * resolved (and validated) once when the configuration file is loaded.
+         * @param table The name of the systematic table.
+         * @return The systematic parameters of the table.
+         * @throw ConfigurationError
+         */
+        const std::vector<SystematicConfig> & get_systematics(const std::string & table) const;
     
     private:
         toml::table config; ///< The TOML configuration table.
+        JobConfig job; ///< The resolved global configuration.
+        std::vector<TreeConfig> trees; ///< The resolved [[tree]] entries.
+        std::map<std::string, std::vector<SystematicConfig>> systematics; ///< The resolved systematic tables.
 
         /**
          * @brief Validate the configuration file.
          * @details This function validates the configuration file by checking
-         * that all the requisite fields are present.
+         * that all the requisite fields are present. The [[tree]] entries and
+         * all systematic tables they reference are resolved into typed
+         * structs, checking the fields required by the action of each tree,
+         * so that an invalid configuration fails before any I/O is done.
          * @return void
          * @throw ConfigurationError
          */
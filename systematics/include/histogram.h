@@ -0,0 +1,322 @@
+/**
+ * @file histogram.h
+ * @brief Header and implementation of the UniverseHistogram class.
+ * @details This file contains the implementation of the UniverseHistogram
+ * class, which fills the same histogram of a variable once per systematic
+ * universe in a single pass over the selected signal candidates. The bin of
+ * each candidate is computed once, and the weights of all universes are then
+ * accumulated into a contiguous block of memory (universes are the innermost
+ * dimension), which the compiler vectorizes across universes.
+ * @author mueller@fnal.gov
+ */
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+
+#include "TH1D.h"
+#include "TH2D.h"
+
+/**
+ * @namespace sys::hist
+ * @brief Namespace for the classes that histogram variables over the
+ * systematic universes.
+ * @details This namespace contains the classes that histogram variables of
+ * the selected signal candidates over the universes of the configured
+ * systematics. The resulting per-universe spectra are the input for the
+ * covariance matrices of the systematics.
+ */
+namespace sys::hist
+{
+    /**
+     * @class UniverseHistogram
+     * @brief A class that fills a histogram of a variable for each of a set
+     * of systematic universes in a single pass.
+     * @details The histogram has a nominal spectrum (the sum of the candidate
+     * weights) and one spectrum per universe (the sum of the candidate
+     * weights multiplied by the universe weights). The bins include the
+     * underflow (bin 0) and overflow (bin nbins+1) bins, following the ROOT
+     * convention. The contents are stored bin-major with the universes as the
+     * innermost dimension, so a single candidate updates one contiguous row.
+     */
+    class UniverseHistogram
+    {
+    public:
+        /**
+         * @brief Constructor for the UniverseHistogram class.
+         * @param edges The (increasing) bin edges of the variable.
+         * @param nuniv The number of universes.
+         */
+        UniverseHistogram(const std::vector<double> & edges, size_t nuniv)
+            : edges(edges), nuniv(nuniv), nominal(edges.size() + 1, 0.0), contents((edges.size() + 1) * nuniv, 0.0) {}
+
+        /**
+         * @brief Find the bin of a value of the variable.
+         * @param x The value of the variable.
+         * @return The bin (0 for underflow, nbins+1 for overflow).
+         */
+        size_t FindBin(double x) const
+        {
+            return std::upper_bound(edges.begin(), edges.end(), x) - edges.begin();
+        }
+
+        /**
+         * @brief Fill a candidate into the nominal and universe spectra.
+         * @tparam T The type of the universe weights (float or double).
+         * @param x The value of the variable.
+         * @param weights The weights of the universes (nuniv values).
+         * @param w The (central value) weight of the candidate.
+         * @return void
+         */
+        template<class T>
+            void Fill(double x, const T * weights, double w = 1.0)
+            {
+                size_t bin(FindBin(x));
+                nominal[bin] += w;
+                FillUniverses(bin, weights, w);
+            }
+
+        /**
+         * @brief Fill a candidate into the universe spectra of a known bin.
+         * @details This is the innermost loop of the class. The universe
+         * weights and the contents of the bin are both contiguous, so the
+         * loop is vectorized across universes.
+         * @tparam T The type of the universe weights (float or double).
+         * @param bin The bin of the candidate (see @ref FindBin()).
+         * @param weights The weights of the universes (nuniv values).
+         * @param w The (central value) weight of the candidate.
+         * @return void
+         */
+        template<class T>
+            void FillUniverses(size_t bin, const T * weights, double w = 1.0)
+            {
+                double * row(contents.data() + bin * nuniv);
+                for(size_t u(0); u < nuniv; ++u)
+                    row[u] += w * weights[u];
+            }
+
+        /**
+         * @brief Fill a candidate into the nominal spectrum of a known bin.
+         * @param bin The bin of the candidate (see @ref FindBin()).
+         * @param w The (central value) weight of the candidate.
+         * @return void
+         */
+        void FillNominal(size_t bin, double w = 1.0) { nominal[bin] += w; }
+
+        /**
+         * @brief Get the number of bins (excluding underflow and overflow).
+         * @return The number of bins.
+         */
+        size_t GetNbins() const { return edges.size() - 1; }
+
+        /**
+         * @brief Get the number of universes.
+         * @return The number of universes.
+         */
+        size_t GetNuniv() const { return nuniv; }
+
+        /**
+         * @brief Get the bin edges of the variable.
+         * @return The bin edges.
+         */
+        const std::vector<double> & GetEdges() const { return edges; }
+
+        /**
+         * @brief Get the content of a bin of the nominal spectrum.
+         * @param bin The bin (0 for underflow, nbins+1 for overflow).
+         * @return The content of the bin.
+         */
+        double GetNominal(size_t bin) const { return nominal[bin]; }
+
+        /**
+         * @brief Get the content of a bin of a universe spectrum.
+         * @param bin The bin (0 for underflow, nbins+1 for overflow).
+         * @param u The universe.
+         * @return The content of the bin.
+         */
+        double GetContent(size_t bin, size_t u) const { return contents[bin * nuniv + u]; }
+
+        /**
+         * @brief Create a TH1D of the nominal spectrum.
+         * @param name The name of the histogram.
+         * @return The histogram (owned by the caller).
+         */
+        TH1D * MakeNominal(const std::string & name) const
+        {
+            TH1D * h = new TH1D(name.c_str(), name.c_str(), GetNbins(), edges.data());
+            h->SetDirectory(nullptr);
+            for(size_t b(0); b < nominal.size(); ++b)
+                h->SetBinContent(b, nominal[b]);
+            return h;
+        }
+
+        /**
+         * @brief Create a TH2D of a range of universe spectra.
+         * @details The x-axis is the variable and the y-axis is the universe,
+         * so each row (fixed y) of the histogram is the spectrum of a single
+         * universe.
+         * @param name The name of the histogram.
+         * @param offset The first universe of the range.
+         * @param n The number of universes in the range.
+         * @return The histogram (owned by the caller).
+         */
+        TH2D * MakeUniverses(const std::string & name, size_t offset, size_t n) const
+        {
+            TH2D * h = new TH2D(name.c_str(), name.c_str(), GetNbins(), edges.data(), n, 0, n);
+            h->SetDirectory(nullptr);
+            for(size_t b(0); b < nominal.size(); ++b)
+            {
+                for(size_t u(0); u < n; ++u)
+                    h->SetBinContent(b, u+1, contents[b * nuniv + offset + u]);
+            }
+            return h;
+        }
+
+        /**
+         * @brief Compute the mean spectrum of a range of universes.
+         * @param offset The first universe of the range.
+         * @param n The number of universes in the range.
+         * @return The mean content of each bin (excluding flow bins).
+         */
+        std::vector<double> GetMean(size_t offset, size_t n) const
+        {
+            std::vector<double> mean(GetNbins(), 0.0);
+            for(size_t b(0); b < GetNbins(); ++b)
+            {
+                const double * row(contents.data() + (b+1) * nuniv + offset);
+                for(size_t u(0); u < n; ++u)
+                    mean[b] += row[u];
+                mean[b] /= std::max<size_t>(n, 1);
+            }
+            return mean;
+        }
+
+        /**
+         * @brief Compute the covariance matrix of a range of universes.
+         * @details The covariance is computed with respect to the nominal
+         * spectrum, C_ij = 1/n sum_u (N_i^u - N_i^nom)(N_j^u - N_j^nom), which
+         * is the usual convention for multisim universes. Flow bins are
+         * excluded.
+         * @param offset The first universe of the range.
+         * @param n The number of universes in the range.
+         * @return The covariance matrix (row-major, nbins x nbins).
+         */
+        std::vector<double> GetCovariance(size_t offset, size_t n) const
+        {
+            size_t nb(GetNbins());
+            std::vector<double> cov(nb * nb, 0.0);
+            std::vector<double> delta(nb);
+            for(size_t u(0); u < n; ++u)
+            {
+                for(size_t b(0); b < nb; ++b)
+                    delta[b] = contents[(b+1) * nuniv + offset + u] - nominal[b+1];
+                for(size_t i(0); i < nb; ++i)
+                {
+                    for(size_t j(0); j < nb; ++j)
+                        cov[i * nb + j] += delta[i] * delta[j];
+                }
+            }
+            for(double & c : cov)
+                c /= std::max<size_t>(n, 1);
+            return cov;
+        }
+
+        /**
+         * @brief Compute the covariance matrix of a multisigma parameter.
+         * @details The parameter is treated as a single Gaussian nuisance
+         * whose +/-1 sigma universes bracket the nominal spectrum, so the
+         * covariance is the outer product of the symmetric shift,
+         * C_ij = d_i d_j with d_i = (N_i^+1 - N_i^-1) / 2. Flow bins are
+         * excluded.
+         * @param plus The universe of the +1 sigma shift.
+         * @param minus The universe of the -1 sigma shift.
+         * @return The covariance matrix (row-major, nbins x nbins).
+         */
+        std::vector<double> GetSigmaCovariance(size_t plus, size_t minus) const
+        {
+            size_t nb(GetNbins());
+            std::vector<double> cov(nb * nb, 0.0);
+            std::vector<double> delta(nb);
+            for(size_t b(0); b < nb; ++b)
+                delta[b] = 0.5 * (contents[(b+1) * nuniv + plus] - contents[(b+1) * nuniv + minus]);
+            for(size_t i(0); i < nb; ++i)
+            {
+                for(size_t j(0); j < nb; ++j)
+                    cov[i * nb + j] = delta[i] * delta[j];
+            }
+            return cov;
+        }
+
+        /**
+         * @brief Create a TH2D of a (nbins x nbins) matrix in the binning of
+         * the variable.
+         * @param name The name of the histogram.
+         * @param matrix The matrix (row-major, nbins x nbins).
+         * @return The histogram (owned by the caller).
+         */
+        TH2D * MakeMatrix(const std::string & name, const std::vector<double> & matrix) const
+        {
+            size_t nb(GetNbins());
+            TH2D * h = new TH2D(name.c_str(), name.c_str(), nb, edges.data(), nb, edges.data());
+            h->SetDirectory(nullptr);
+            for(size_t i(0); i < nb; ++i)
+            {
+                for(size_t j(0); j < nb; ++j)
+                    h->SetBinContent(i+1, j+1, matrix[i * nb + j]);
+            }
+            return h;
+        }
+
+        /**
+         * @brief Create a TH1D of a spectrum with an error band.
+         * @param name The name of the histogram.
+         * @param content The content of each bin (excluding flow bins).
+         * @param cov The covariance matrix whose diagonal is the squared error
+         * of each bin.
+         * @return The histogram (owned by the caller).
+         */
+        TH1D * MakeBand(const std::string & name, const std::vector<double> & content, const std::vector<double> & cov) const
+        {
+            size_t nb(GetNbins());
+            TH1D * h = new TH1D(name.c_str(), name.c_str(), nb, edges.data());
+            h->SetDirectory(nullptr);
+            for(size_t b(0); b < nb; ++b)
+            {
+                h->SetBinContent(b+1, content[b]);
+                h->SetBinError(b+1, std::sqrt(std::max(cov[b * nb + b], 0.0)));
+            }
+            return h;
+        }
+
+    private:
+        std::vector<double> edges; ///< The bin edges of the variable.
+        size_t nuniv; ///< The number of universes.
+        std::vector<double> nominal; ///< The nominal spectrum (with flow bins).
+        std::vector<double> contents; ///< The universe spectra (bin-major).
+    };
+
+    /**
+     * @brief Compute the correlation matrix of a covariance matrix.
+     * @details Bins with zero variance have zero correlation with all other
+     * bins (and themselves).
+     * @param cov The covariance matrix (row-major, n x n).
+     * @return The correlation matrix (row-major, n x n).
+     */
+    std::vector<double> correlation(const std::vector<double> & cov)
+    {
+        size_t n(std::sqrt(cov.size()) + 0.5);
+        std::vector<double> corr(cov.size(), 0.0);
+        for(size_t i(0); i < n; ++i)
+        {
+            for(size_t j(0); j < n; ++j)
+            {
+                double norm(std::sqrt(cov[i * n + i] * cov[j * n + j]));
+                corr[i * n + j] = norm > 0 ? cov[i * n + j] / norm : 0.0;
+            }
+        }
+        return corr;
+    }
+}
+#endif // HISTOGRAM_H
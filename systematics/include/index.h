@@ -0,0 +1,210 @@
+/**
+ * @file index.h
+ * @brief Header and implementation of the hash-based index of the selected
+ * signal candidates.
+ * @details This file contains the implementation of the index used to match
+ * the selected signal candidates with the neutrino interactions in the input
+ * CAF files. Each candidate is identified by its (run, subrun, event, nu_id),
+ * which is packed into a 128-bit integer key and stored in a flat
+ * open-addressing hash table. A lookup is then a single hash and (typically)
+ * a single probe into contiguous memory, with no floating-point comparisons.
+ * @author mueller@fnal.gov
+ */
+#ifndef INDEX_H
+#define INDEX_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <limits>
+
+/**
+ * @namespace sys::index
+ * @brief Namespace for the hash-based index of the selected signal candidates.
+ * @details This namespace contains the packed integer key identifying a
+ * selected signal candidate and the flat hash table that maps these keys to
+ * the entry of the candidate in the input TTree.
+ */
+namespace sys::index
+{
+    /**
+     * @struct key_t
+     * @brief A packed 128-bit key identifying a neutrino interaction.
+     * @details The first word packs the run (upper 32 bits) and subrun (lower
+     * 32 bits), and the second word packs the event (upper 32 bits) and the
+     * neutrino id (lower 32 bits).
+     */
+    struct key_t
+    {
+        uint64_t hi;
+        uint64_t lo;
+        bool operator==(const key_t & other) const { return hi == other.hi && lo == other.lo; }
+    };
+
+    /**
+     * @brief Pack the identifiers of a neutrino interaction into a key.
+     * @details The neutrino id is truncated to 32 bits, so negative values
+     * (e.g. -1 for candidates without a parent neutrino) map to a fixed value
+     * that does not collide with any valid (non-negative) neutrino id.
+     * @param run The run number.
+     * @param subrun The subrun number.
+     * @param event The event number.
+     * @param nu_id The id of the neutrino interaction within the event.
+     * @return The packed key.
+     */
+    inline key_t make_key(uint32_t run, uint32_t subrun, uint32_t event, int64_t nu_id)
+    {
+        return key_t{(uint64_t(run) << 32) | subrun, (uint64_t(event) << 32) | uint32_t(nu_id)};
+    }
+
+    /**
+     * @brief Pack the identifiers of an event into a key.
+     * @details This key identifies the event as a whole (the neutrino id is
+     * fixed to zero), and is only meaningful within an index of events.
+     * @param run The run number.
+     * @param subrun The subrun number.
+     * @param event The event number.
+     * @return The packed key.
+     */
+    inline key_t make_event_key(uint32_t run, uint32_t subrun, uint32_t event)
+    {
+        return make_key(run, subrun, event, 0);
+    }
+
+    /**
+     * @class CandidateIndex
+     * @brief A flat open-addressing hash table mapping keys to entries.
+     * @details The table uses linear probing over a power-of-two number of
+     * slots, and is grown to keep the load factor at or below one half. Keys
+     * are unique: inserting a key that is already present keeps the original
+     * entry (the same behavior as std::map::insert). The table is read-only
+     * once built, so concurrent lookups are safe.
+     */
+    class CandidateIndex
+    {
+    public:
+        static constexpr size_t npos = std::numeric_limits<size_t>::max(); ///< The value returned for missing keys.
+
+        /**
+         * @brief Constructor for the CandidateIndex class.
+         * @param expected The expected number of keys (used to size the table).
+         */
+        CandidateIndex(size_t expected = 0) : nentries(0) { rehash(capacity_for(expected)); }
+
+        /**
+         * @brief Insert a key into the index.
+         * @param key The key to insert.
+         * @param value The entry associated with the key.
+         * @return True if the key was inserted, false if it was already present.
+         */
+        bool insert(const key_t & key, size_t value)
+        {
+            if(2 * (nentries + 1) > slots.size())
+                rehash(2 * slots.size());
+            slot_t & s(slots[probe(key)]);
+            if(s.value != npos)
+                return false;
+            s = slot_t{key, value};
+            ++nentries;
+            return true;
+        }
+
+        /**
+         * @brief Look up the entry associated with a key.
+         * @param key The key to look up.
+         * @return The entry associated with the key, or @ref npos if missing.
+         */
+        size_t find(const key_t & key) const { return slots[probe(key)].value; }
+
+        /**
+         * @brief Check if a key is present in the index.
+         * @param key The key to look up.
+         * @return True if the key is present.
+         */
+        bool contains(const key_t & key) const { return find(key) != npos; }
+
+        /**
+         * @brief Get the number of keys in the index.
+         * @return The number of keys.
+         */
+        size_t size() const { return nentries; }
+
+    private:
+        /**
+         * @struct slot_t
+         * @brief A slot of the hash table (empty if the value is npos).
+         */
+        struct slot_t
+        {
+            key_t key;
+            size_t value;
+        };
+
+        /**
+         * @brief Compute the hash of a key.
+         * @details The two words are combined and then mixed with the
+         * finalizer of splitmix64, which spreads the (highly regular) run,
+         * subrun, and event numbers over all bits of the hash.
+         * @param key The key to hash.
+         * @return The hash of the key.
+         */
+        static uint64_t hash(const key_t & key)
+        {
+            uint64_t h(key.hi * 0x9e3779b97f4a7c15ULL ^ key.lo);
+            h ^= h >> 30;
+            h *= 0xbf58476d1ce4e5b9ULL;
+            h ^= h >> 27;
+            h *= 0x94d049bb133111ebULL;
+            h ^= h >> 31;
+            return h;
+        }
+
+        /**
+         * @brief Compute the smallest power-of-two capacity holding the
+         * requested number of keys at a load factor of at most one half.
+         * @param n The number of keys.
+         * @return The capacity.
+         */
+        static size_t capacity_for(size_t n)
+        {
+            size_t capacity(16);
+            while(capacity < 2 * n)
+                capacity *= 2;
+            return capacity;
+        }
+
+        /**
+         * @brief Find the slot holding a key, or the empty slot where it
+         * would be inserted.
+         * @param key The key to look up.
+         * @return The position of the slot.
+         */
+        size_t probe(const key_t & key) const
+        {
+            size_t mask(slots.size() - 1);
+            size_t i(hash(key) & mask);
+            while(slots[i].value != npos && !(slots[i].key == key))
+                i = (i + 1) & mask;
+            return i;
+        }
+
+        /**
+         * @brief Resize the table and re-insert all keys.
+         * @param capacity The new (power-of-two) number of slots.
+         * @return void
+         */
+        void rehash(size_t capacity)
+        {
+            std::vector<slot_t> old(capacity, slot_t{key_t{0, 0}, npos});
+            old.swap(slots);
+            for(const slot_t & s : old)
+            {
+                if(s.value != npos)
+                    slots[probe(s.key)] = s;
+            }
+        }
+
+        std::vector<slot_t> slots; ///< The slots of the hash table.
+        size_t nentries; ///< The number of keys in the table.
+    };
+}
+#endif // INDEX_H
@@ -12,13 +12,28 @@
 #ifndef TREES_H
 #define TREES_H
 #include <iostream>
+#include <fstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <iterator>
 
 #include "utilities.h"
+#include "index.h"
+#include "histogram.h"
 #include "configuration.h"
 
+#include "TROOT.h"
 #include "TFile.h"
 #include "TDirectory.h"
 #include "TTree.h"
+#include "TLeaf.h"
+#include "TObjArray.h"
 #include "TTreeReader.h"
 #include "TTreeReaderValue.h"
 #include "TTreeReaderArray.h"
@@ -39,162 +54,705 @@
 namespace sys::trees
 {
     /**
-     * @brief Type definitions for the selected signal candidates and the
-     * universe weights.
+     * @struct match_t
+     * @brief Struct to store a selected signal candidate matched to a neutrino
+     * in the input CAF files.
+     * @details The struct stores the entry of the selected signal candidate in
+     * the input TTree, the (run, subrun, event) of the matched neutrino, and
+     * the universe weights of each configured systematic (in the iteration
+     * order of the systematics). This is the unit of work handed from the
+     * workers processing the CAF files to the merge into the output TTrees.
      */
-    typedef std::tuple<Double_t, Double_t, Double_t, Double_t> index_t;
-    typedef std::map<index_t, size_t> map_t;
+    struct match_t
+    {
+        size_t entry;
+        uint32_t run;
+        uint32_t subrun;
+        uint32_t event;
+        std::vector<std::vector<double>> weights;
+    };
+
+    /**
+     * @struct selection_t
+     * @brief Struct storing the selected signal candidates of a selection
+     * TTree in memory.
+     * @details The struct stores the names of the columns of the selection
+     * TTree (and the position of "nu_id" among them), the values of the
+     * columns (as doubles) of every entry as a flat row-major table, and the
+     * indices used to match the candidates with the neutrinos of the input
+     * CAF files.
+     * @see read_selection()
+     */
+    struct selection_t
+    {
+        std::vector<std::string> names;
+        size_t inu;
+        std::vector<double> rows;
+        sys::index::CandidateIndex candidates;
+        sys::index::CandidateIndex events;
+    };
+
+    /**
+     * @struct flat_syst_t
+     * @brief Struct describing the placement of a single systematic parameter
+     * within the flattened weight block of its systematic type.
+     * @details The universes of the systematic occupy the range
+     * [offset, offset + nuniv) of the block. The position is the index of the
+     * systematic within the weights of a @ref match_t.
+     */
+    struct flat_syst_t
+    {
+        std::string name;
+        int64_t index;
+        size_t position;
+        size_t offset;
+        size_t nuniv;
+    };
+
+    /**
+     * @struct flat_table_t
+     * @brief Struct storing the flattened weight block of a systematic type.
+     * @details In the "flat" output format, the universes of all systematic
+     * parameters of a type are stored as a single float array per row, whose
+     * length is stored in the "nweights" branch. Both branches are booked
+     * when the output TTree is created, so the TTree has them even if no
+     * candidate is matched. The number of universes of each parameter (and
+     * so the length of the array) is fixed by the first matched candidate.
+     */
+    struct flat_table_t
+    {
+        std::vector<flat_syst_t> systs;
+        std::vector<float> block;
+        Int_t nweights;
+        bool sized;
+    };
+
+    /**
+     * @brief The branches of the CAF recTree that are read when adding weight
+     * systematics.
+     * @details Only the header fields used to match candidates and the two
+     * fields of each true interaction that are used (the neutrino index and
+     * the universe weights) are read. Wildcards follow the conventions of
+     * TTree::SetBranchStatus().
+     */
+    const std::vector<std::string> caf_weight_branches = {
+        "rec.hdr.run",
+        "rec.hdr.subrun",
+        "rec.hdr.evt",
+        "rec.mc.nu.index",
+        "rec.mc.nu.wgt*"
+    };
+
+    /**
+     * @brief Disable all branches of a TTree except for the requested ones.
+     * @details This function disables all branches of the TTree and then
+     * re-enables only the requested branches. For split objects, enabling a
+     * sub-branch also enables its parent branches, so the requested leaves
+     * can still be read through a reader of the full (parent) object with
+     * all other members left unset. Disabled branches are neither read nor
+     * decompressed, which greatly reduces the I/O volume per entry.
+     * @param tree The TTree to prune.
+     * @param branches The names (or wildcard patterns) of the branches to
+     * keep enabled.
+     * @return void
+     */
+    void prune_branches(TTree * tree, const std::vector<std::string> & branches)
+    {
+        tree->SetBranchStatus("*", false);
+        for(const std::string & b : branches)
+            tree->SetBranchStatus(b.c_str(), true);
+    }
+
+    /**
+     * @brief Copy the universe weights of a matched candidate into the
+     * flattened weight blocks.
+     * @details This function copies the universe weights of each systematic
+     * parameter into its range of the float block of its type. The first
+     * call fixes the number of universes of each parameter, sizes the block,
+     * and connects it to the (already booked) "weights" branch of each
+     * systematic type. Subsequent candidates with fewer universes are padded
+     * with unit weights, and extra universes are dropped (with a warning).
+     * @param flat The flattened weight blocks of each systematic type.
+     * @param systrees The output TTrees of each systematic type.
+     * @param row The matched candidate.
+     * @return void
+     */
+    void fill_flat_weights(std::map<std::string, flat_table_t> & flat, std::map<std::string, TTree *> & systrees, const match_t & row)
+    {
+        for(auto & [s, f] : flat)
+        {
+            if(!f.sized)
+            {
+                size_t offset(0);
+                for(flat_syst_t & fs : f.systs)
+                {
+                    fs.offset = offset;
+                    fs.nuniv = row.weights[fs.position].size();
+                    offset += fs.nuniv;
+                }
+                f.block.assign(offset, 1.0f);
+                f.nweights = offset;
+                systrees[s]->SetBranchAddress("weights", f.block.data());
+                f.sized = true;
+            }
+            for(const flat_syst_t & fs : f.systs)
+            {
+                const std::vector<double> & w(row.weights[fs.position]);
+                if(w.size() > fs.nuniv)
+                    std::cerr << "Warning: Systematic " << fs.name << " has " << w.size() << " universes (expected " << fs.nuniv << ")." << std::endl;
+                size_t n(std::min(w.size(), fs.nuniv));
+                std::copy_n(w.begin(), n, f.block.begin() + fs.offset);
+                std::fill(f.block.begin() + fs.offset + n, f.block.begin() + fs.offset + fs.nuniv, 1.0f);
+            }
+        }
+    }
+
+    /**
+     * @brief Write the schema of a flattened weight block.
+     * @details The schema is a TTree named after the systematic type (with
+     * the suffix "Schema") with one entry per systematic parameter, storing
+     * the name, the index of the parameter in the CAF weights, and the range
+     * [offset, offset + nuniv) of the parameter within the "weights" array of
+     * the weights TTree of the type.
+     * @param directory The output directory.
+     * @param name The name of the systematic type.
+     * @param f The flattened weight block of the systematic type.
+     * @return void
+     */
+    void write_flat_schema(TDirectory * directory, const std::string & name, const flat_table_t & f)
+    {
+        TTree * schema = new TTree((name+"Schema").c_str(), (name+"Schema").c_str());
+        std::string sname;
+        Long64_t index, offset, nuniv;
+        schema->Branch("name", &sname);
+        schema->Branch("index", &index);
+        schema->Branch("offset", &offset);
+        schema->Branch("nuniv", &nuniv);
+        for(const flat_syst_t & fs : f.systs)
+        {
+            sname = fs.name;
+            index = fs.index;
+            offset = fs.offset;
+            nuniv = fs.nuniv;
+            schema->Fill();
+        }
+        directory->WriteObject(schema, (name+"Schema").c_str());
+    }
 
     /**
      * @brief Copy the input TTree to the output TTree.
      * @details This function copies the input TTree to the output TTree. The
-     * function loops over the input TTree and copies the values of the branches
-     * to the output TTree. The output TTree is created with the same branches
-     * as the input TTree.
-     * @param table The table that contains the configuration for the tree.
+     * output TTree is a clone of the input TTree, so it has the same branches
+     * (of any type) as the input TTree. The copy mode is configured by the
+     * optional "mode" field of the tree:
+     *  - "fast" (default): the compressed baskets of the input TTree are
+     *    copied directly to the output file without being decompressed, so
+     *    the copy is bound by I/O bandwidth. ROOT falls back to an
+     *    entry-by-entry copy if the baskets cannot be copied as-is.
+     *  - "typed": the entries are read and filled one-by-one through the
+     *    branch addresses connected by the clone, so every branch is copied
+     *    with its own type and the baskets are re-compressed with the
+     *    settings of the output file.
+     * @param tree The configuration of the tree.
      * @param output The output TFile.
      * @param input The input TFile.
      * @return void
+     * @throw sys::cfg::ConfigurationError
      */
-    void copy_tree(sys::cfg::ConfigurationTable & table, TFile * output, TFile * input)
+    void copy_tree(const sys::cfg::TreeConfig & tree, TFile * output, TFile * input)
     {
         /**
          * @brief Create the output subdirectory following the nesting outlined
          * in the configuration file.
          */
         TDirectory * directory = (TDirectory *) output;
-        directory = create_directory(directory, table.get_string_field("destination").c_str());
-        
-        /**
-         * @brief Create the output TTree with the name specified in the
-         * configuration file.
-         */
-        TTree * output_tree = new TTree(table.get_string_field("name").c_str(), table.get_string_field("name").c_str());
+        directory = create_directory(directory, tree.destination.c_str());
 
         /**
-         * @brief Connect to the input TTree and associated branches.
-         * @details Three are N+3 branches in the input TTree, where N is the
-         * number of branches in the input TTree of type double. The three
-         * other branches (Run, Subrun, Evt) are of type int. This block uses
-         * a single array to store the values of the double branches and three
-         * separate variables to store the values of the int branches.
+         * @brief Connect to the input TTree.
          */
-        TTree * input_tree = (TTree *) input->Get(table.get_string_field("origin").c_str());
-        int run, subrun, event;
-        double br[input_tree->GetNbranches()-3];
-        for (int i = 0; i < input_tree->GetNbranches()-3; i++)
-            input_tree->SetBranchAddress(input_tree->GetListOfBranches()->At(i)->GetName(), br+i);
-        input_tree->SetBranchAddress("Run", &run);
-        input_tree->SetBranchAddress("Subrun", &subrun);
-        input_tree->SetBranchAddress("Evt", &event);
+        TTree * input_tree = (TTree *) input->Get(tree.origin.c_str());
+        if(!input_tree)
+            throw sys::cfg::ConfigurationError("TTree " + tree.origin + " not found.");
 
         /**
-         * @brief Create the branches in the output TTree following the same
-         * structure as the input TTree.
-         * @details The same array (type double) and three variables (type int)
-         * as used above with the input TTree are used to create the branches
-         * in the output TTree. The branches are created in the same order as
-         * the input TTree. This process streamlines the copying of the values
-         * from the input TTree to the output TTree.
+         * @brief Clone the input TTree into the output directory.
+         * @details The clone is attached to the current directory, so the
+         * output directory is made current first. The baskets of the clone
+         * are then written to the output file as they are filled (or copied).
          */
-        for (int i = 0; i < input_tree->GetNbranches()-3; i++)
-            output_tree->Branch(input_tree->GetListOfBranches()->At(i)->GetName(), br+i);
-        output_tree->Branch("Run", &run);
-        output_tree->Branch("Subrun", &subrun);
-        output_tree->Branch("Evt", &event);
+        directory->cd();
+        TTree * output_tree;
+        if(tree.mode == "typed")
+        {
+            output_tree = input_tree->CloneTree(0);
+            output_tree->CopyEntries(input_tree);
+        }
+        else
+            output_tree = input_tree->CloneTree(-1, "fast");
+        output_tree->SetName(tree.name.c_str());
+        output_tree->SetTitle(tree.name.c_str());
 
         /**
-         * @brief Loop over the input TTree and copy the values to the output
-         * TTree.
+         * @brief Write the output TTree to the output ROOT file.
          */
-        for(int i(0); i < input_tree->GetEntries(); ++i)
+        directory->WriteObject(output_tree, tree.name.c_str());
+    }
+
+    /**
+     * @struct column_reader_t
+     * @brief Struct reading a numeric branch of a TTree as a double.
+     * @details The TTrees written by the cafana Analysis class store their
+     * columns as doubles by default, but may store them with smaller types
+     * (e.g. float, integer, or boolean columns), and store the Run, Subrun,
+     * and Evt as Int_t. A double branch is connected directly to the value,
+     * while any other branch is read through its leaf once the entry is
+     * loaded (see @ref read_column()).
+     */
+    struct column_reader_t
+    {
+        TLeaf * leaf; ///< The leaf of the branch (nullptr if connected directly).
+        double * value; ///< The value of the branch in the current entry.
+    };
+
+    /**
+     * @brief Connect a numeric branch of a TTree to a double.
+     * @param tree The TTree.
+     * @param name The name of the branch.
+     * @param value The value of the branch in the current entry.
+     * @return The reader of the branch.
+     * @throw sys::cfg::ConfigurationError if the TTree has no such branch.
+     */
+    column_reader_t connect_column(TTree * tree, const std::string & name, double * value)
+    {
+        TLeaf * leaf = tree->GetLeaf(name.c_str());
+        if(!leaf)
+            throw sys::cfg::ConfigurationError("TTree " + std::string(tree->GetName()) + " has no branch " + name + ".");
+        if(std::string(leaf->GetTypeName()) != "Double_t")
+            return column_reader_t{leaf, value};
+        tree->SetBranchAddress(name.c_str(), value);
+        return column_reader_t{nullptr, value};
+    }
+
+    /**
+     * @brief Update the value of a branch once its entry is loaded.
+     * @param column The reader of the branch.
+     * @return void
+     */
+    void read_column(const column_reader_t & column)
+    {
+        if(column.leaf)
+            *column.value = column.leaf->GetValue(0);
+    }
+
+    /**
+     * @brief Read the selected signal candidates of a selection TTree.
+     * @details The input TTree has N+3 branches: the N columns of the
+     * selection, followed by the Run, Subrun, and Evt of each entry. The
+     * columns are doubles unless the TTree was written with storage types
+     * (see cafana/include/storage.h), and the identifiers are of type int;
+     * all branches are read as doubles (see @ref column_reader_t). This
+     * function loops over the input TTree once (in
+     * order) and reads the columns of every candidate into a flat
+     * in-memory table (one row per entry), so the matched candidates are later
+     * copied from memory rather than read back from the input TTree in the
+     * (effectively random) order of the CAF files. The same pass builds an
+     * index of the packed key (run, subrun, event, nu_id) of each candidate
+     * to its entry, and a second index of the (run, subrun, event) of the
+     * candidates, which is used to skip events (and files) of the input CAF
+     * files that cannot contain a match before their true interaction
+     * information is read. The "nu_id" branch is read through its position in
+     * the row.
+     * @param input_tree The selection TTree.
+     * @param selection The selected signal candidates (output).
+     * @return True if the selection was read, false if the TTree has no
+     * "nu_id" branch.
+     * @throw sys::cfg::ConfigurationError if the last three branches of the
+     * TTree are not Run, Subrun, and Evt.
+     * @see sys::index::CandidateIndex
+     */
+    bool read_selection(TTree * input_tree, selection_t & selection)
+    {
+        const char * identifiers[3] = {"Run", "Subrun", "Evt"};
+        TObjArray * branches = input_tree->GetListOfBranches();
+        size_t nbr(input_tree->GetNbranches() < 3 ? 0 : input_tree->GetNbranches()-3);
+        for(size_t k(0); k < 3; ++k)
+        {
+            if(input_tree->GetNbranches() < 3 || std::string(branches->At(nbr+k)->GetName()) != identifiers[k])
+                throw sys::cfg::ConfigurationError("TTree " + std::string(input_tree->GetName()) + " does not end with the Run, Subrun, and Evt branches.");
+        }
+        selection.names.clear();
+        selection.inu = nbr;
+        for(size_t i(0); i < nbr; ++i)
+        {
+            selection.names.push_back(branches->At(i)->GetName());
+            if(selection.names.back() == "nu_id")
+                selection.inu = i;
+        }
+        if(selection.inu == nbr)
+            return false;
+
+        std::vector<double> br(nbr + 3, 0.0);
+        std::vector<column_reader_t> columns;
+        for(size_t i(0); i < nbr; ++i)
+            columns.push_back(connect_column(input_tree, selection.names[i], &br[i]));
+        for(size_t k(0); k < 3; ++k)
+            columns.push_back(connect_column(input_tree, identifiers[k], &br[nbr+k]));
+
+        Long64_t nentries(input_tree->GetEntries());
+        selection.candidates = sys::index::CandidateIndex(nentries);
+        selection.events = sys::index::CandidateIndex(nentries);
+        selection.rows.assign(nentries * nbr, 0.0);
+        for(Long64_t i(0); i < nentries; ++i)
         {
             input_tree->GetEntry(i);
-            output_tree->Fill();
+            for(const column_reader_t & c : columns)
+                read_column(c);
+            uint32_t run(br[nbr]), subrun(br[nbr+1]), event(br[nbr+2]);
+            std::copy(br.begin(), br.begin() + nbr, selection.rows.begin() + i * nbr);
+            selection.candidates.insert(sys::index::make_key(run, subrun, event, int64_t(br[selection.inu])), i);
+            selection.events.insert(sys::index::make_event_key(run, subrun, event), i);
         }
+        input_tree->ResetBranchAddresses();
+        return true;
+    }
+
+    /**
+     * @struct weight_request_t
+     * @brief Struct storing a request for the universe weights of the selected
+     * signal candidates of a single tree.
+     * @details Each action that consumes universe weights is split into a
+     * planning step, which reads its selection and prepares its outputs, and
+     * a request that is served by the single shared pass over the input CAF
+     * files (see @ref match_weight_systematics()). The sink and the finish
+     * functions own the state of the action, including the selection.
+     */
+    struct weight_request_t
+    {
+        std::string label; ///< The label used for progress reports.
+        std::shared_ptr<const selection_t> selection; ///< The selected signal candidates.
+        std::map<std::string, int64_t> systs; ///< The systematics (name to CAF weight index) of the request.
+        std::function<void(match_t &)> sink; ///< The function called (in file list order) for each match.
+        std::function<void()> finish; ///< The function called once all CAF files are processed.
+    };
+
+    /**
+     * @brief Match the selected signal candidates of a set of requests with
+     * the neutrinos of the input CAF files and hand the universe weights of
+     * each match to the sink of its request.
+     * @details This function loops over the CAF files of "input.caflist"
+     * once, using a pool of workers, and produces a @ref match_t for each
+     * neutrino matching a selected signal candidate of any request. A
+     * neutrino may match candidates of several requests, in which case each
+     * request receives its own match (with the weights of its own
+     * systematics). The matches are handed to the sinks in a deterministic
+     * order (the order of the file list, then the order of the requests),
+     * with the sinks called under a lock so that they need not be
+     * thread-safe. The finish function of each request is called (in order)
+     * once all files are processed. This is the common backend of the actions
+     * that consume universe weights.
+     * @param job The global configuration of the job.
+     * @param requests The requests served by the pass over the CAF files.
+     * The weights of each match are stored in the iteration order of the
+     * systematics of its request.
+     * @return void
+     */
+    void match_weight_systematics(const sys::cfg::JobConfig & job, const std::vector<weight_request_t> & requests)
+    {
+        if(requests.empty())
+            return;
 
         /**
-         * @brief Write the output TTree to the output ROOT file.
+         * @brief Load the input CAF files.
+         * @details This block loads the input CAF files. The input CAF files
+         * are specified in a file list that is read from the configuration
+         * file. The file list is read line-by-line and the input CAF files are
+         * stored in a vector.
+         */
+        std::vector<std::string> input_files;
+        std::ifstream file_list(job.caflist);
+        std::string line;
+        while(std::getline(file_list, line))
+            input_files.push_back(line);
+        file_list.close();
+
+        /**
+         * @brief Configure the pool of workers that process the CAF files.
+         * @details The CAF files are independent of each other, so they may be
+         * processed concurrently by a pool of workers. The number of workers
+         * is configured by the optional field "input.nthreads" (default 1). A
+         * value of zero uses one worker per available hardware thread. ROOT is
+         * only made thread-safe if more than one worker is requested.
+         */
+        size_t nthreads(std::max<int64_t>(0, job.nthreads));
+        if(nthreads == 0)
+            nthreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+        nthreads = std::min(nthreads, std::max<size_t>(1, input_files.size()));
+        if(nthreads > 1)
+            ROOT::EnableThreadSafety();
+
+        /**
+         * @brief Process a single input CAF file.
+         * @details This function opens the input CAF file, loops over its
+         * events, and stores a @ref match_t for each neutrino interaction
+         * matching a selected signal candidate of any request. Only read-only
+         * access to the shared state (candidates and systematics) is
+         * performed, so the function may be called concurrently on different
+         * files.
+         * @param input_file The path to the input CAF file.
+         * @param rows The matched candidates of the file, per request (output).
+         * @return void
+         */
+        auto process_file = [&requests](const std::string & input_file, std::vector<std::vector<match_t>> & rows)
+        {
+            /**
+             * @brief Open and validate the input CAF file.
+             * @details This block opens the input CAF file and checks that the
+             * files is not a zombie (corrupted) and that it contains the TTree
+             * "recTree". If the file is a zombie or does not contain the TTree,
+             * the code prints an error message and continues to the next file.
+             * Practically, skipping a file means that signal events from that file
+             * will not be included in the output ROOT file, though a situation
+             * where this occurs is not expected.
+             */
+            TFile * caf = TFile::Open(input_file.c_str(), "READ");
+            if(!caf || caf->IsZombie() || !caf->GetListOfKeys()->Contains("recTree"))
+            {
+                std::cerr << "Error: File " << input_file << " does not exist." << std::endl;
+                delete caf;
+                return;
+            }
+
+            /**
+             * @brief Connect to the input CAF file fields.
+             * @details This block connects to a minimal set of the input CAF file
+             * fields. We need the run, subrun, event, and the true interaction
+             * (parent neutrino) information to match the selected signal
+             * candidates and retrieve the universe weights. All other branches
+             * of the CAF file are disabled, so only the neutrino index and the
+             * universe weights of each true interaction are deserialized (the
+             * remaining fields of the SRTrueInteraction are left unset).
+             * @see caf_weight_branches
+             */
+            TTree * rec = caf->Get<TTree>("recTree");
+            prune_branches(rec, caf_weight_branches);
+            TTreeReader reader(rec);
+            TTreeReaderValue<uint32_t> rrun(reader, "rec.hdr.run");
+            TTreeReaderValue<uint32_t> rsubrun(reader, "rec.hdr.subrun");
+            TTreeReaderValue<uint32_t> revt(reader, "rec.hdr.evt");
+            TTreeReaderArray<caf::SRTrueInteraction> mc(reader, "rec.mc.nu");
+
+            /**
+             * @brief Find the events of the input CAF file with candidates.
+             * @details This block performs a first pass over the events of the
+             * input CAF file that accesses only the header. TTreeReader reads
+             * branches lazily, so the (much larger) true interaction branches
+             * are not read in this pass. Events whose (run, subrun, event) do
+             * not contain any selected signal candidate of any request are
+             * skipped, and a file without any such event is closed without
+             * reading anything but its header.
+             */
+            std::vector<Long64_t> entries;
+            while(reader.Next())
+            {
+                sys::index::key_t key(sys::index::make_event_key(*rrun, *rsubrun, *revt));
+                if(std::any_of(requests.begin(), requests.end(), [&key](const weight_request_t & r) { return r.selection->events.contains(key); }))
+                    entries.push_back(reader.GetCurrentEntry());
+            }
+
+            /**
+             * @brief Loop over the events in the input CAF file with candidates.
+             * @details This block loops over the events in the input CAF file
+             * that contain at least one selected signal candidate. At each
+             * event, the code checks if a neutrino interaction from the input
+             * CAF file matches a selected signal candidate of each request. If
+             * a match is found, the code stores the entry of the selected
+             * signal candidate and the universe weights (in the iteration
+             * order of the systematics of the request) for the parent neutrino.
+             */
+            rows.resize(requests.size());
+            for(Long64_t entry : entries)
+            {
+                reader.SetEntry(entry);
+                for(const caf::SRTrueInteraction & nu : mc)
+                {
+                    sys::index::key_t key(sys::index::make_key(*rrun, *rsubrun, *revt, nu.index));
+                    for(size_t r(0); r < requests.size(); ++r)
+                    {
+                        size_t candidate(requests[r].selection->candidates.find(key));
+                        if(candidate == sys::index::CandidateIndex::npos)
+                            continue;
+                        match_t row{candidate, *rrun, *rsubrun, *revt, {}};
+                        row.weights.reserve(requests[r].systs.size());
+                        for(auto & [name, value] : requests[r].systs)
+                            row.weights.emplace_back(nu.wgt[value].univ.begin(), nu.wgt[value].univ.end());
+                        rows[r].push_back(std::move(row));
+                    }
+                } // End of loop over the neutrino interactions in the input CAF file.
+            } // End of loop over the events in the input CAF file.
+            caf->Close();
+            delete caf;
+        };
+
+        /**
+         * @brief Merge the matched candidates into the output.
+         * @details The matched candidates of each file are handed to the sinks
+         * strictly in the order of the file list, regardless of the order in
+         * which the workers finish. This keeps the output identical to a
+         * serial run. Files are flushed as soon as all files
+         * preceding them are complete, so only the rows of the files that
+         * finished "out of order" are held in memory. The caller must hold
+         * the output lock.
+         */
+        std::vector<std::vector<std::vector<match_t>>> pending(input_files.size());
+        std::vector<bool> complete(input_files.size(), false);
+        size_t next_flush(0);
+        auto flush = [&]()
+        {
+            for(; next_flush < input_files.size() && complete[next_flush]; ++next_flush)
+            {
+                for(size_t r(0); r < pending[next_flush].size(); ++r)
+                {
+                    for(match_t & row : pending[next_flush][r])
+                        requests[r].sink(row);
+                }
+                std::vector<std::vector<match_t>>().swap(pending[next_flush]);
+            }
+        };
+
+        /**
+         * @brief Loop over the input CAF files.
+         * @details This block loops over the input CAF files. This loop begins
+         * the process of matching the selected signal candidates with the universe
+         * weights for parent neutrino. Each worker claims the next unprocessed
+         * file, processes it without holding any lock, and then hands its rows
+         * to the (locked) ordered merge and progress report. Exceptions thrown
+         * by a worker are rethrown once all workers have finished.
          */
-        directory->WriteObject(output_tree, table.get_string_field("name").c_str());
+        std::string label;
+        for(const weight_request_t & r : requests)
+            label += (label.empty() ? "" : ", ") + r.label;
+        ProgressReporter progress(label, input_files.size());
+        std::atomic<size_t> next_file(0);
+        std::mutex output_mutex;
+        std::exception_ptr error;
+        auto worker = [&]()
+        {
+            try
+            {
+                for(size_t f(next_file++); f < input_files.size(); f = next_file++)
+                {
+                    std::vector<std::vector<match_t>> rows;
+                    process_file(input_files[f], rows);
+                    size_t matched(0);
+                    for(const std::vector<match_t> & r : rows)
+                        matched += r.size();
+                    std::lock_guard<std::mutex> lock(output_mutex);
+                    progress.update(matched);
+                    pending[f] = std::move(rows);
+                    complete[f] = true;
+                    flush();
+                }
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock(output_mutex);
+                if(!error)
+                    error = std::current_exception();
+                next_file = input_files.size();
+            }
+        };
+
+        if(nthreads > 1)
+        {
+            std::vector<std::thread> pool;
+            for(size_t i(0); i < nthreads; ++i)
+                pool.emplace_back(worker);
+            for(std::thread & t : pool)
+                t.join();
+        }
+        else
+            worker();
+        if(error)
+            std::rethrow_exception(error);
+        for(const weight_request_t & r : requests)
+            r.finish();
     }
 
     /**
-     * @brief Add reweightable systematics to the output TTree.
-     * @details This function adds reweightable systematics to the output
-     * TTree. The function loops over the input TTree to build a map for the
-     * selected signal candidates to their index in the input TTree. The
-     * function then loops over the neutrinos in the CAF input files and
-     * populates the output TTree with the selected signal candidates and the
-     * universe weights for matched neutrinos.
-     * @param table The table that contains the configuration for the tree.
+     * @brief Plan the addition of reweightable systematics to the output
+     * TTree.
+     * @details This function reads the selected signal candidates of the
+     * input TTree and creates the output TTrees (the copy of the selection
+     * and one weight TTree per systematic type). The returned request
+     * populates the output TTrees with the selected signal candidates and the
+     * universe weights for matched neutrinos as the single pass over the
+     * input CAF files streams them in, and writes them to the output file
+     * once the pass is complete.
+     * @param config The full configuration of the job.
+     * @param tree The configuration of the tree.
      * @param output The output TFile.
      * @param input The input TFile.
+     * @param requests The requests of the job (the new request is appended).
      * @return void
+     * @throw sys::cfg::ConfigurationError
+     * @see match_weight_systematics()
      */
-    void copy_with_weight_systematics(sys::cfg::ConfigurationTable & config, sys::cfg::ConfigurationTable & table, TFile * output, TFile * input)
+    void plan_weight_systematics(const sys::cfg::ConfigurationTable & config, const sys::cfg::TreeConfig & tree, TFile * output, TFile * input,
+                                 std::vector<weight_request_t> & requests)
     {
+        /**
+         * @brief The state of the action, shared by its sink and finish
+         * functions. The branches of the output TTrees are connected to its
+         * members, so it must not move once the TTrees are created.
+         */
+        struct state_t
+        {
+            selection_t selection;
+            TDirectory * directory;
+            TTree * output_tree;
+            std::vector<double> br;
+            Int_t run, subrun, event;
+            std::map<std::string, int64_t> systs;
+            std::map<std::string, TTree *> systrees;
+            std::map<int64_t, std::vector<double>*> weights;
+            std::map<std::string, flat_table_t> flat;
+        };
+        std::shared_ptr<state_t> state(std::make_shared<state_t>());
+
         /**
          * @brief Create the output subdirectory following the nesting outlined
          * in the configuration file.
          */
-        TDirectory * directory = (TDirectory *) output;
-        directory = create_directory(directory, table.get_string_field("destination").c_str());
+        state->directory = create_directory((TDirectory *) output, tree.destination.c_str());
         
         /**
-         * @brief Connect to the input TTree and associated branches.
-         * @details Three are N+3 branches in the input TTree, where N is the
-         * number of branches in the input TTree of type double. The three
-         * other branches (Run, Subrun, Evt) are of type int. This block uses
-         * a single array to store the values of the double branches and three
-         * separate variables to store the values of the int branches. There is
-         * one quirk, however, as we would also like to have access to the
-         * "nu_id" branch in the input TTree directly.
+         * @brief Read the selected signal candidates.
+         * @see read_selection()
          */
-        TTree * input_tree = (TTree *) input->Get(table.get_string_field("origin").c_str());
-        double br[input_tree->GetNbranches()-3];
-        double nu_id;
-        Int_t run, subrun, event;
-        for(int i(0); i < input_tree->GetNbranches()-3; ++i)
-            input_tree->SetBranchAddress(input_tree->GetListOfBranches()->At(i)->GetName(), br+i);
-        input_tree->SetBranchAddress("nu_id", &nu_id);
-        input_tree->SetBranchAddress("Run", &run);
-        input_tree->SetBranchAddress("Subrun", &subrun);
-        input_tree->SetBranchAddress("Evt", &event);
-
+        TTree * input_tree = (TTree *) input->Get(tree.origin.c_str());
+        selection_t & selection(state->selection);
+        if(!input_tree || !read_selection(input_tree, selection))
+            throw sys::cfg::ConfigurationError("TTree " + tree.origin + " not found or has no nu_id branch.");
 
         /**
          * @brief Create the output TTree with the name specified in the
          * configuration file.
          * @details The output TTree is created with the same branches as the
-         * input TTree, plus the Run, Subrun, and Evt branches. The same array
-         * (type double) and three variables (type int) as used above with the
-         * input TTree are used to create the branches in the output TTree. The
-         * branches are created in the same order as the input TTree. This
-         * process streamlines the copying of the values from the input TTree to
-         * the output TTree.
-         */
-        TTree * output_tree = new TTree(table.get_string_field("name").c_str(), table.get_string_field("name").c_str());
-        for (int i(0); i < input_tree->GetNbranches()-3; ++i)
-            output_tree->Branch(input_tree->GetListOfBranches()->At(i)->GetName(), br+i);
-        output_tree->Branch("Run", &run);
-        output_tree->Branch("Subrun", &subrun);
-        output_tree->Branch("Evt", &event);
-        
-        /**
-         * @brief Create the map of selected signal candidates.
-         * @details This block creates a map of selected signal candidates. The
-         * map is built by looping over the input TTree and storing the index
-         * (run, subrun, event, nu_id) of the selected signal candidates in the
-         * map. The index is used to match the selected signal candidates with
-         * the universe weights for the parent neutrino.
+         * input TTree, plus the Run, Subrun, and Evt branches. A single array
+         * (type double) and three variables (type int) are used to create the
+         * branches in the output TTree. The branches are created in the same
+         * order as the input TTree, so each matched candidate is copied from
+         * the in-memory table of the selection with a single copy of its row.
          */
-        map_t candidates;
-        for(int i(0); i < input_tree->GetEntries(); ++i)
-        {
-            input_tree->GetEntry(i);
-            candidates.insert(std::make_pair<index_t, size_t>(std::make_tuple(run, subrun, event, nu_id), i));
-        }
+        size_t nbr(selection.names.size());
+        state->br.resize(nbr);
+        state->output_tree = new TTree(tree.name.c_str(), tree.name.c_str());
+        for(size_t i(0); i < nbr; ++i)
+            state->output_tree->Branch(selection.names[i].c_str(), &state->br[i]);
+        state->output_tree->Branch("Run", &state->run);
+        state->output_tree->Branch("Subrun", &state->subrun);
+        state->output_tree->Branch("Evt", &state->event);
 
         /**
          * @brief Configure the weight-based systematics.
@@ -203,22 +761,23 @@ namespace sys::trees
          * enforced by the configuration file. Because we do not wish to loop
          * over the selected signal candidates multiple times, we must store
          * the systematic information in such a way that we can easily
-         * accomodate this scheme. The variable "systables" is a vector of
-         * vectors of @ref sys::cfg::ConfigurationTables, with an inner vector
-         * for each systematic parameter and an outer vector for grouping the
-         * systematics by type. The variable "systs" is a map that maps the
+         * accomodate this scheme. The variable "systs" is a map that maps the
          * name of the systematic parameter to its index within the input
          * weights. The variable "systrees" is a map that serves as a container
          * for the output TTrees of each systematic type keyed by the name of
          * the type. The variable "weights" is a map with a key of the index of
          * the systematic parameter and a value of std::vector<double>* that is
-         * used to connect the universe weights to the output TTree.
+         * used to connect the universe weights to the output TTree. If the
+         * optional "format" field of the tree is "flat", the variable "flat"
+         * instead stores a single float block per systematic type (see
+         * @ref flat_table_t) and "weights" is unused.
          */
-        std::vector<std::vector<sys::cfg::ConfigurationTable>> systables;
-        std::map<std::string, int64_t> systs;
-        std::map<std::string, TTree *> systrees;
-        std::map<int64_t, std::vector<double>*> weights;
-        
+        std::map<std::string, int64_t> & systs(state->systs);
+        std::map<std::string, TTree *> & systrees(state->systrees);
+        std::map<int64_t, std::vector<double>*> & weights(state->weights);
+        std::map<std::string, flat_table_t> & flat(state->flat);
+        bool is_flat(tree.format == "flat");
+
         /**
          * @brief Loop over the systematic types in the configuration file.
          * @details This block loops over the systematic types in the
@@ -228,9 +787,8 @@ namespace sys::trees
          * loop is used to load and configure the systematics of each type in
          * sequential order.
          */
-        for(std::string & s : table.get_string_vector("table"))
+        for(const std::string & s : tree.tables)
         {
-            systables.push_back(config.get_subtables(s));
             systrees[s] = new TTree((s+"Tree").c_str(), (s+"Tree").c_str());
 
             /**
@@ -240,122 +798,434 @@ namespace sys::trees
              * the systematics into a single set of maps for use below in the
              * loop over the input CAF files. The TTree of each systematic type
              * is extended with a vector of doubles for each systematic
-             * parameter belonging to the type.
+             * parameter belonging to the type (or, in the "flat" format, the
+             * parameter is assigned a range of the float block of the type).
              */
-            for(sys::cfg::ConfigurationTable & t : systables.back())
+            for(const sys::cfg::SystematicConfig & t : config.get_systematics(s))
             {
-                systs.insert(std::make_pair<std::string, int64_t>(t.get_string_field("name"), t.get_int_field("index")));
-                weights.insert(std::make_pair<int64_t, std::vector<double>*>(t.get_int_field("index"), new std::vector<double>));
-                systrees[s]->Branch(t.get_string_field("name").c_str(), &weights[t.get_int_field("index")]);
+                systs.insert(std::make_pair(t.name, t.index));
+                if(is_flat)
+                {
+                    flat[s].systs.push_back({t.name, t.index, 0, 0, 0});
+                    continue;
+                }
+                weights.insert(std::make_pair(t.index, new std::vector<double>));
+                systrees[s]->Branch(t.name.c_str(), &weights[t.index]);
             }
         }
 
         /**
-         * @brief Load the input CAF files.
-         * @details This block loads the input CAF files. The input CAF files
-         * are specified in a file list that is read from the configuration
-         * file. The file list is read line-by-line and the input CAF files are
-         * stored in a vector.
+         * @brief Resolve the position of each systematic within the weights
+         * of a matched candidate (the iteration order of "systs") and book
+         * the branches of the flat weight blocks.
+         * @details The "weights" array is connected to its block once the
+         * block is sized by the first matched candidate (see
+         * @ref fill_flat_weights()).
          */
-        std::vector<std::string> input_files;
-        std::ifstream file_list(config.get_string_field("input.caflist"));
-        std::string line;
-        while(std::getline(file_list, line))
-            input_files.push_back(line);
-        file_list.close();
+        for(auto & [s, f] : flat)
+        {
+            f.nweights = 0;
+            f.sized = false;
+            for(flat_syst_t & fs : f.systs)
+                fs.position = std::distance(systs.begin(), systs.find(fs.name));
+            systrees[s]->Branch("nweights", &f.nweights, "nweights/I");
+            systrees[s]->Branch("weights", f.block.data(), "weights[nweights]/F");
+        }
 
         /**
-         * @brief Loop over the input CAF files.
-         * @details This block loops over the input CAF files. This loop begins
-         * the process of matching the selected signal candidates with the universe
-         * weights for parent neutrino. 
+         * @brief Request the universe weights of the selected signal
+         * candidates.
+         * @details The sink copies each matched candidate (from the in-memory
+         * table of the selection) and its universe weights to the output
+         * TTrees, and the finish function writes the output TTrees.
          */
-        size_t nprocessed(0);
-        for(std::string input_file : input_files)
+        std::string name(tree.name);
+        auto sink = [state, nbr, is_flat](match_t & row)
         {
-            if(nprocessed % 100 == 0)
-                std::cout << "Processed " << nprocessed << " files." << std::endl;
             /**
-             * @brief Open and validate the input CAF file.
-             * @details This block opens the input CAF file and checks that the
-             * files is not a zombie (corrupted) and that it contains the TTree
-             * "recTree". If the file is a zombie or does not contain the TTree,
-             * the code prints an error message and continues to the next file.
-             * Practically, skipping a file means that signal events from that file
-             * will not be included in the output ROOT file, though a situation
-             * where this occurs is not expected.
+             * @brief Retrieve the selected signal candidate and copy the
+             * values to the output TTree.
+             * @details This block retrieves the selected signal candidate that
+             * has been matched with the parent neutrino from the in-memory
+             * table and copies the values to the output TTree.
              */
-            TFile * caf = TFile::Open(input_file.c_str(), "READ");
-            if(caf->IsZombie() || !caf->GetListOfKeys()->Contains("recTree"))
-            {
-                std::cerr << "Error: File" << input_file << " does not exist." << std::endl;
-                continue;
-            }
+            std::copy_n(state->selection.rows.begin() + row.entry * nbr, nbr, state->br.begin());
+            state->run = row.run;
+            state->subrun = row.subrun;
+            state->event = row.event;
+            state->output_tree->Fill();
 
             /**
-             * @brief Connect to the input CAF file fields.
-             * @details This block connects to a minimal set of the input CAF file
-             * fields. We need the run, subrun, event, and the true interaction
-             * (parent neutrino) information to match the selected signal
-             * candidates and retrieve the universe weights.
+             * @brief Store the universe weights in the output TTree.
+             * @details This block stores the universe weights in the output
+             * TTree for each of the configured systematics.
              */
-            TTreeReader reader("recTree", caf);
-            TTreeReaderValue<uint32_t> rrun(reader, "rec.hdr.run");
-            TTreeReaderValue<uint32_t> rsubrun(reader, "rec.hdr.subrun");
-            TTreeReaderValue<uint32_t> revt(reader, "rec.hdr.evt");
-            TTreeReaderArray<caf::SRTrueInteraction> mc(reader, "rec.mc.nu");
+            if(is_flat)
+                fill_flat_weights(state->flat, state->systrees, row);
+            else
+            {
+                size_t k(0);
+                for(auto & [key, value] : state->systs)
+                    state->weights[value]->swap(row.weights[k++]);
+            }
+            for(auto & [key, value] : state->systrees)
+                value->Fill();
+        };
+        auto finish = [state, name]()
+        {
+            state->directory->WriteObject(state->output_tree, name.c_str());
+            for(auto & [key, value] : state->systrees)
+                state->directory->WriteObject(value, (key+"Tree").c_str());
+            for(auto & [key, value] : state->flat)
+                write_flat_schema(state->directory, key, value);
+        };
+        requests.push_back(weight_request_t{name, std::shared_ptr<const selection_t>(state, &state->selection), systs, sink, finish});
+    }
 
-            /**
-             * @brief Loop over the events in the input CAF file.
-             * @details This block loops over the events in the input CAF file. At
-             * each event, the code checks if a neutrino interaction from the input
-             * CAF file matches a selected signal candidate. If a match is found,
-             * the code retrieves the universe weights for the parent neutrino and
-             * stores them in the output TTree.
-             */
-            while(reader.Next())
+    /**
+     * @brief Fill the universe spectra of a variable from a selection TTree
+     * and its weight TTrees.
+     * @details This function reads a TTree of selected signal candidates and
+     * the weight TTrees produced by @ref plan_weight_systematics() for
+     * it (in either the "vector" or the "flat" format), and fills the
+     * spectrum of the configured variable for every universe of every
+     * configured systematic in a single pass. The weight TTrees are expected
+     * in the same directory as the selection TTree and row-aligned with it.
+     * For each systematic parameter, a TH2D (variable vs. universe) named
+     * "<name>_<parameter>" is written to the destination directory, along
+     * with the nominal spectrum "<name>_nominal". The source is typically the
+     * output file of the same job, so the trees written by an earlier
+     * "add_weights" action can be histogrammed directly.
+     * @param tree The configuration of the tree.
+     * @param output The output TFile.
+     * @param source The TFile containing the selection and weight TTrees.
+     * @return void
+     * @throw sys::cfg::ConfigurationError
+     */
+    void fill_universe_histograms(const sys::cfg::TreeConfig & tree, TFile * output, TFile * source)
+    {
+        /**
+         * @brief Create the output subdirectory following the nesting outlined
+         * in the configuration file.
+         */
+        TDirectory * directory = (TDirectory *) output;
+        directory = create_directory(directory, tree.destination.c_str());
+        std::string name(tree.name);
+
+        /**
+         * @brief Connect to the selection TTree.
+         * @details Only the branch of the histogrammed variable is read.
+         */
+        std::string origin(tree.origin);
+        std::string parent(origin.find_last_of("/") != std::string::npos ? origin.substr(0, origin.find_last_of("/")+1) : "");
+        TTree * input_tree = source->Get<TTree>(origin.c_str());
+        if(!input_tree)
+            throw sys::cfg::ConfigurationError("TTree " + origin + " not found.");
+        std::string variable(tree.variable);
+        double x(0);
+        prune_branches(input_tree, {variable});
+        column_reader_t column(connect_column(input_tree, variable, &x));
+
+        /**
+         * @brief Connect to the weight TTrees.
+         * @details Each systematic type is read into a single contiguous block
+         * of universe weights per row, laid out as described by the schema of
+         * the "flat" format. For the "vector" format, the layout is built from
+         * the sizes of the vectors of the first row and the vectors are
+         * copied into the block at each row.
+         */
+        struct weight_source_t
+        {
+            TTree * tree;
+            std::vector<flat_syst_t> systs;
+            std::vector<float> block;
+            std::vector<std::vector<double> *> vectors;
+        };
+        std::vector<weight_source_t> sources;
+        for(const std::string & s : tree.tables)
+        {
+            weight_source_t ws{source->Get<TTree>((parent + s + "Tree").c_str()), {}, {}, {}};
+            if(!ws.tree)
+                throw sys::cfg::ConfigurationError("TTree " + parent + s + "Tree not found.");
+            TTree * schema = source->Get<TTree>((parent + s + "Schema").c_str());
+            if(schema)
             {
-                for(const caf::SRTrueInteraction & nu : mc)
+                std::string * sname = nullptr;
+                Long64_t index, offset, nuniv;
+                schema->SetBranchAddress("name", &sname);
+                schema->SetBranchAddress("index", &index);
+                schema->SetBranchAddress("offset", &offset);
+                schema->SetBranchAddress("nuniv", &nuniv);
+                size_t total(0);
+                for(Long64_t i(0); i < schema->GetEntries(); ++i)
                 {
-                    index_t index(*rrun, *rsubrun, *revt, nu.index);
-                    if(candidates.find(index) != candidates.end())
-                    {
-                        /**
-                         * @brief Retrieve the selected signal candidate and copy
-                         * the values to the output TTree.
-                         * @details This block retrieves the selected signal
-                         * candidate that has been matched with the parent neutrino
-                         * and copies the values to the output TTree.
-                         */
-                        input_tree->GetEntry(candidates[index]);
-                        run = *rrun;
-                        subrun = *rsubrun;
-                        event = *revt;
-                        output_tree->Fill();
-                        
-                        /**
-                         * @brief Store the universe weights in the output TTree.
-                         * @details This block stores the universe weights in the
-                         * output TTree for each of the configured systematics.  
-                         */
-                        for(auto & [key, value] : systs)
-                        {
-                            weights[value]->clear();
-                            for(size_t u(0); u < nu.wgt[value].univ.size(); ++u)
-                                weights[value]->push_back(nu.wgt[value].univ[u]);
-                        } // End of loop over the configured systematics.
-                        for(auto & [key, value] : systrees)
-                            value->Fill();
-                    }
-                } // End of loop over the neutrino interactions in the input CAF file.
-            } // End of loop over the events in the input CAF file.
-            caf->Close();
-            nprocessed++;
-        } // End of loop over the input CAF files.
-        input->Close();
-        directory->WriteObject(output_tree, table.get_string_field("name").c_str());
-        for(auto & [key, value] : systrees)
-            directory->WriteObject(value, (key+"Tree").c_str());
-    }   
+                    schema->GetEntry(i);
+                    ws.systs.push_back({*sname, index, size_t(i), size_t(offset), size_t(nuniv)});
+                    total = std::max(total, size_t(offset + nuniv));
+                }
+                ws.block.resize(total);
+                ws.tree->SetBranchAddress("weights", ws.block.data());
+            }
+            else
+            {
+                TObjArray * branches = ws.tree->GetListOfBranches();
+                ws.vectors.resize(branches->GetEntries(), nullptr);
+                for(int b(0); b < branches->GetEntries(); ++b)
+                {
+                    if(ws.tree->SetBranchAddress(branches->At(b)->GetName(), &ws.vectors[b]) < 0)
+                        throw sys::cfg::ConfigurationError("Branch " + std::string(branches->At(b)->GetName()) + " of TTree " + parent + s + "Tree is not a vector of universe weights.");
+                }
+                size_t offset(0);
+                if(ws.tree->GetEntries() > 0)
+                    ws.tree->GetEntry(0);
+                for(int b(0); b < branches->GetEntries(); ++b)
+                {
+                    size_t nuniv(ws.vectors[b] ? ws.vectors[b]->size() : 0);
+                    ws.systs.push_back({branches->At(b)->GetName(), -1, size_t(b), offset, nuniv});
+                    offset += nuniv;
+                }
+                ws.block.resize(offset);
+            }
+            sources.push_back(std::move(ws));
+        }
+
+        /**
+         * @brief Fill the universe spectra in a single pass.
+         * @details The bin of each candidate is computed once and shared by
+         * the nominal spectrum and all universes of all systematic types.
+         */
+        const std::vector<double> & edges(tree.bins);
+        sys::hist::UniverseHistogram nominal(edges, 0);
+        std::vector<sys::hist::UniverseHistogram> histograms;
+        for(weight_source_t & ws : sources)
+            histograms.emplace_back(edges, ws.block.size());
+        for(Long64_t i(0); i < input_tree->GetEntries(); ++i)
+        {
+            input_tree->GetEntry(i);
+            read_column(column);
+            size_t bin(nominal.FindBin(x));
+            nominal.FillNominal(bin);
+            for(size_t k(0); k < sources.size(); ++k)
+            {
+                weight_source_t & ws(sources[k]);
+                ws.tree->GetEntry(i);
+                for(size_t b(0); b < ws.vectors.size(); ++b)
+                {
+                    if(!ws.vectors[b])
+                        throw sys::cfg::ConfigurationError("Systematic " + ws.systs[b].name + " of TTree " + ws.tree->GetName() + " has no universe weights at entry " + std::to_string(i) + ".");
+                    const flat_syst_t & fs(ws.systs[b]);
+                    size_t n(std::min(fs.nuniv, ws.vectors[b]->size()));
+                    std::copy_n(ws.vectors[b]->begin(), n, ws.block.begin() + fs.offset);
+                    std::fill(ws.block.begin() + fs.offset + n, ws.block.begin() + fs.offset + fs.nuniv, 1.0f);
+                }
+                histograms[k].FillUniverses(bin, ws.block.data());
+            }
+        }
+
+        /**
+         * @brief Write the nominal and universe spectra to the output file.
+         */
+        directory->WriteObject(nominal.MakeNominal(name + "_nominal"), (name + "_nominal").c_str());
+        for(size_t k(0); k < sources.size(); ++k)
+        {
+            for(const flat_syst_t & fs : sources[k].systs)
+            {
+                std::string hname(name + "_" + fs.name);
+                directory->WriteObject(histograms[k].MakeUniverses(hname, fs.offset, fs.nuniv), hname.c_str());
+            }
+        }
+    }
+
+    /**
+     * @brief Plan the computation of the covariance matrices and error bands
+     * of a variable directly from the universe weights of the input CAF files.
+     * @details The returned request receives the matches of the selected
+     * signal candidates in the same way as @ref plan_weight_systematics(), but
+     * instead of writing the weights TTrees, it accumulates the universe
+     * spectra of the configured variable for each systematic parameter as the
+     * matches stream in. Only the (bins x universes) contents are held in
+     * memory, so the weights are never materialized. The following objects
+     * are written to the destination directory once the pass over the input
+     * CAF files is complete:
+     *  - "<name>_nominal": the nominal spectrum of the matched candidates.
+     *  - "<name>_<parameter>_cov"/"_corr": the covariance and correlation
+     *    matrices of each systematic parameter. The universes of multisim
+     *    parameters are spread with respect to the nominal, while the
+     *    parameters of the tables listed in the "sigma_tables" field of the
+     *    tree use the outer product of half the difference of their +1 and
+     *    -1 sigma universes (located through its "sigmas" field). The number
+     *    of universes of these parameters is checked at their first match.
+     *  - "<name>_<parameter>_mean": the mean spectrum of the universes, with
+     *    the square root of the diagonal of the covariance as the error
+     *    (multisim parameters only).
+     *  - "<name>_<parameter>_band": the nominal spectrum with the same error.
+     *  - "<name>_<type>_cov"/"_corr"/"_band": the same for the sum of the
+     *    covariance matrices of all parameters of each systematic type, and
+     *    "<name>_total_cov"/"_corr"/"_band" for all configured types.
+     * @param config The full configuration of the job.
+     * @param tree The configuration of the tree.
+     * @param output The output TFile.
+     * @param input The input TFile.
+     * @param requests The requests of the job (the new request is appended).
+     * @return void
+     * @throw sys::cfg::ConfigurationError
+     * @see match_weight_systematics()
+     */
+    void plan_covariance(const sys::cfg::ConfigurationTable & config, const sys::cfg::TreeConfig & tree, TFile * output, TFile * input,
+                         std::vector<weight_request_t> & requests)
+    {
+        /**
+         * @brief The state of the action, shared by its sink and finish
+         * functions.
+         */
+        struct state_t
+        {
+            selection_t selection;
+            std::map<std::string, int64_t> systs;
+            std::map<std::string, std::string> types;
+            std::vector<bool> multisigma;
+            sys::hist::UniverseHistogram nominal;
+            std::vector<std::unique_ptr<sys::hist::UniverseHistogram>> histograms;
+            std::vector<double> scratch;
+        };
+        std::shared_ptr<state_t> state(std::make_shared<state_t>(state_t{{}, {}, {}, {}, sys::hist::UniverseHistogram(tree.bins, 0), {}, {}}));
+
+        /**
+         * @brief Create the output subdirectory following the nesting outlined
+         * in the configuration file.
+         */
+        TDirectory * directory = create_directory((TDirectory *) output, tree.destination.c_str());
+        std::string name(tree.name);
+
+        /**
+         * @brief Read the selected signal candidates and locate the variable.
+         * @see read_selection()
+         */
+        TTree * input_tree = (TTree *) input->Get(tree.origin.c_str());
+        selection_t & selection(state->selection);
+        if(!input_tree || !read_selection(input_tree, selection))
+            throw sys::cfg::ConfigurationError("TTree " + tree.origin + " not found or has no nu_id branch.");
+        std::vector<std::string>::const_iterator it(std::find(selection.names.begin(), selection.names.end(), tree.variable));
+        if(it == selection.names.end())
+            throw sys::cfg::ConfigurationError("Variable " + tree.variable + " not found in TTree " + tree.origin + ".");
+        size_t ivar(it - selection.names.begin());
+        size_t nbr(selection.names.size());
+
+        /**
+         * @brief Configure the weight-based systematics.
+         * @details The systematics of each configured type are flattened into
+         * a single map of names to their index within the input weights (the
+         * same scheme as @ref plan_weight_systematics()). The variable
+         * "types" records the type of each systematic parameter.
+         */
+        for(const std::string & s : tree.tables)
+        {
+            for(const sys::cfg::SystematicConfig & t : config.get_systematics(s))
+            {
+                state->systs.insert(std::make_pair(t.name, t.index));
+                state->types.insert(std::make_pair(t.name, s));
+            }
+        }
+        state->histograms.resize(state->systs.size());
+        for(auto & [key, value] : state->systs)
+        {
+            const std::string & type(state->types[key]);
+            state->multisigma.push_back(std::find(tree.sigma_tables.begin(), tree.sigma_tables.end(), type) != tree.sigma_tables.end());
+        }
+
+        /**
+         * @brief Locate the +1 and -1 sigma universes of the multisigma
+         * parameters (validated by the configuration).
+         */
+        const std::vector<double> & sigmas(tree.sigmas);
+        size_t iplus(std::find(sigmas.begin(), sigmas.end(), 1.0) - sigmas.begin());
+        size_t iminus(std::find(sigmas.begin(), sigmas.end(), -1.0) - sigmas.begin());
+        size_t nsigma(sigmas.size());
+
+        /**
+         * @brief Accumulate the universe spectra of each systematic parameter.
+         * @details The histogram of each parameter is created at the first
+         * match, which fixes its number of universes. Matches with fewer
+         * universes are padded with unit weights (extra universes are
+         * dropped). The bin of each candidate is computed once and shared by
+         * all parameters.
+         */
+        const std::vector<double> & edges(tree.bins);
+        auto sink = [state, edges, nbr, ivar, nsigma, name](match_t & row)
+        {
+            sys::hist::UniverseHistogram & nominal(state->nominal);
+            std::vector<std::unique_ptr<sys::hist::UniverseHistogram>> & histograms(state->histograms);
+            size_t bin(nominal.FindBin(state->selection.rows[row.entry * nbr + ivar]));
+            nominal.FillNominal(bin);
+            for(size_t k(0); k < histograms.size(); ++k)
+            {
+                const std::vector<double> & w(row.weights[k]);
+                if(state->multisigma[k] && w.size() != nsigma)
+                {
+                    std::string key(std::next(state->systs.begin(), k)->first);
+                    throw sys::cfg::ConfigurationError("Multisigma parameter " + key + " has " + std::to_string(w.size()) + " universes, but the field sigmas of tree " + name + " lists " + std::to_string(nsigma) + ".");
+                }
+                if(!histograms[k])
+                    histograms[k] = std::make_unique<sys::hist::UniverseHistogram>(edges, w.size());
+                sys::hist::UniverseHistogram & h(*histograms[k]);
+                h.FillNominal(bin);
+                if(w.size() == h.GetNuniv())
+                    h.FillUniverses(bin, w.data());
+                else
+                {
+                    state->scratch.assign(h.GetNuniv(), 1.0);
+                    std::copy_n(w.begin(), std::min(w.size(), h.GetNuniv()), state->scratch.begin());
+                    h.FillUniverses(bin, state->scratch.data());
+                }
+            }
+        };
+
+        /**
+         * @brief Write the nominal spectrum, the covariance and correlation
+         * matrices, and the error bands to the output file.
+         */
+        auto finish = [state, directory, name, iplus, iminus]()
+        {
+            const sys::hist::UniverseHistogram & nominal(state->nominal);
+            std::vector<double> central(nominal.GetNbins());
+            for(size_t b(0); b < central.size(); ++b)
+                central[b] = nominal.GetNominal(b+1);
+            auto write = [&](const std::string & prefix, const std::vector<double> & cov)
+            {
+                directory->WriteObject(nominal.MakeMatrix(prefix + "_cov", cov), (prefix + "_cov").c_str());
+                directory->WriteObject(nominal.MakeMatrix(prefix + "_corr", sys::hist::correlation(cov)), (prefix + "_corr").c_str());
+                directory->WriteObject(nominal.MakeBand(prefix + "_band", central, cov), (prefix + "_band").c_str());
+            };
+            directory->WriteObject(nominal.MakeNominal(name + "_nominal"), (name + "_nominal").c_str());
+            std::map<std::string, std::vector<double>> totals;
+            std::vector<double> total(central.size() * central.size(), 0.0);
+            size_t k(0);
+            for(auto & [key, value] : state->systs)
+            {
+                bool multisigma(state->multisigma[k]);
+                const std::unique_ptr<sys::hist::UniverseHistogram> & h(state->histograms[k++]);
+                if(!h)
+                    continue;
+                std::vector<double> cov(multisigma ? h->GetSigmaCovariance(iplus, iminus) : h->GetCovariance(0, h->GetNuniv()));
+                write(name + "_" + key, cov);
+                if(!multisigma)
+                {
+                    std::string mname(name + "_" + key + "_mean");
+                    directory->WriteObject(h->MakeBand(mname, h->GetMean(0, h->GetNuniv()), cov), mname.c_str());
+                }
+                std::vector<double> & t(totals[state->types[key]]);
+                t.resize(cov.size(), 0.0);
+                for(size_t i(0); i < cov.size(); ++i)
+                {
+                    t[i] += cov[i];
+                    total[i] += cov[i];
+                }
+            }
+            for(auto & [key, value] : totals)
+                write(name + "_" + key, value);
+            write(name + "_total", total);
+        };
+        requests.push_back(weight_request_t{name, std::shared_ptr<const selection_t>(state, &state->selection), state->systs, sink, finish});
+    }
 }
-#endif
\ No newline at end of file
+#endif
@@ -13,6 +13,8 @@
 #include <map>
 #include <string>
 #include <tuple>
+#include <chrono>
+#include <iomanip>
 
 #include "TTreeReader.h"
 #include "TTreeReaderValue.h"
@@ -50,4 +52,61 @@ TDirectory * create_directory(TDirectory * parent, std::string path)
     }
     return directory;
 }
+
+/**
+ * @class ProgressReporter
+ * @brief A class for reporting the progress of a long-running loop over
+ * input files.
+ * @details This class periodically prints the number of processed files, the
+ * number of matched candidates, the processing rate, and the estimated time
+ * remaining. A report is printed at most once per configured interval (and
+ * always for the final file), so the output remains readable for file lists
+ * with thousands of entries. The class is not internally synchronized; when
+ * used from multiple threads, the caller must serialize calls to
+ * @ref update().
+ */
+class ProgressReporter
+{
+public:
+    /**
+     * @brief Constructor for the ProgressReporter class.
+     * @param label The label prefixed to each report (e.g. the tree name).
+     * @param total The total number of files to be processed.
+     * @param interval The minimum number of seconds between reports.
+     */
+    ProgressReporter(const std::string & label, size_t total, double interval = 10.0)
+        : label(label), total(total), interval(interval), nprocessed(0), nmatched(0),
+          start(std::chrono::steady_clock::now()), last(start) {}
+
+    /**
+     * @brief Record a processed file and print a report if due.
+     * @param matched The number of candidates matched in the processed file.
+     * @return void
+     */
+    void update(size_t matched)
+    {
+        ++nprocessed;
+        nmatched += matched;
+        std::chrono::steady_clock::time_point now(std::chrono::steady_clock::now());
+        if(std::chrono::duration<double>(now - last).count() < interval && nprocessed != total)
+            return;
+        last = now;
+        double elapsed(std::chrono::duration<double>(now - start).count());
+        double rate(elapsed > 0 ? nprocessed / elapsed : 0);
+        double eta(rate > 0 ? (total - nprocessed) / rate : 0);
+        std::cout << "[" << label << "] Processed " << nprocessed << "/" << total << " files ("
+                  << std::fixed << std::setprecision(1) << (total > 0 ? 100.0 * nprocessed / total : 100.0) << "%), "
+                  << nmatched << " matched candidates, " << std::setprecision(2) << rate << " files/s, ETA "
+                  << std::setprecision(0) << eta << " s." << std::defaultfloat << std::endl;
+    }
+
+private:
+    std::string label; ///< The label prefixed to each report.
+    size_t total; ///< The total number of files to be processed.
+    double interval; ///< The minimum number of seconds between reports.
+    size_t nprocessed; ///< The number of files processed so far.
+    size_t nmatched; ///< The number of candidates matched so far.
+    std::chrono::steady_clock::time_point start; ///< The start time of the loop.
+    std::chrono::steady_clock::time_point last; ///< The time of the last report.
+};
 #endif // UTILITIES_H
\ No newline at end of file
@@ -0,0 +1,212 @@
+/**
+ * @file bench.cc
+ * @brief Benchmarks of the matching of the selected signal candidates with
+ * the universe weights of the CAF files.
+ * @details This executable generates a synthetic selection and a set of
+ * synthetic CAF files (a "recTree" of StandardRecords with only the header
+ * and the neutrino weights filled) with a configurable multiplicity. It then
+ * microbenchmarks the candidate index (see index.h) and the universe
+ * histograms (see histogram.h), followed by an end-to-end benchmark of
+ * @ref sys::trees::match_weight_systematics(), the single pass over the CAF
+ * files serving the "add_weights" and "covariance" trees. The results are
+ * printed and written as JSON (see cafana/bench/harness.h).
+ * Usage: bench_systematics [--events N] [--neutrinos N] [--files N]
+ * [--selected F] [--systematics N] [--universes N] [--threads N]
+ * [--min-time S] [--output PATH]
+ * @author mueller@fnal.gov
+ */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <random>
+
+#include "configuration.h"
+#include "trees.h"
+#include "index.h"
+#include "histogram.h"
+
+#include "TROOT.h"
+#include "TFile.h"
+#include "TTree.h"
+
+#include "sbnanaobj/StandardRecord/StandardRecord.h"
+
+#include "bench/harness.h"
+
+/**
+ * @brief Write a synthetic CAF file.
+ * @details Each event has the configured number of neutrinos, and each
+ * neutrino carries the universe weights of the configured number of
+ * systematics. The events of the files are numbered consecutively.
+ * @param path The path of the CAF file.
+ * @param first The event number of the first event of the file.
+ * @param nevents The number of events of the file.
+ * @param nnu The number of neutrinos per event.
+ * @param nsyst The number of systematics per neutrino.
+ * @param nuniv The number of universes per systematic.
+ * @param rng The random number generator of the weights.
+ * @return void
+ */
+void write_caf(const std::string & path, uint32_t first, size_t nevents, size_t nnu, size_t nsyst, size_t nuniv, std::mt19937_64 & rng)
+{
+    std::uniform_real_distribution<float> weight(0.5, 1.5);
+    TFile file(path.c_str(), "RECREATE");
+    TTree * tree = new TTree("recTree", "recTree");
+    caf::StandardRecord * rec = new caf::StandardRecord;
+    tree->Branch("rec", &rec);
+    for(size_t e(0); e < nevents; ++e)
+    {
+        rec->hdr.run = 1;
+        rec->hdr.subrun = (first + e) / 100;
+        rec->hdr.evt = first + e;
+        rec->mc.nu.resize(nnu);
+        rec->mc.nnu = nnu;
+        for(size_t n(0); n < nnu; ++n)
+        {
+            rec->mc.nu[n].index = n;
+            rec->mc.nu[n].wgt.resize(nsyst);
+            for(caf::SRMultiverse & w : rec->mc.nu[n].wgt)
+            {
+                w.univ.resize(nuniv);
+                for(float & u : w.univ)
+                    u = weight(rng);
+            }
+        }
+        tree->Fill();
+    }
+    file.WriteObject(tree, "recTree");
+    file.Close();
+    delete rec;
+}
+
+int main(int argc, char * argv[])
+{
+    gErrorIgnoreLevel = kError;
+    std::map<std::string, std::string> args(bench::parse_arguments(argc, argv, {
+        {"events", "2000"}, {"neutrinos", "2"}, {"files", "4"}, {"selected", "0.2"}, {"systematics", "4"},
+        {"universes", "100"}, {"threads", "1"}, {"seed", "12345"}, {"min-time", "0.1"}, {"output", "bench_systematics.json"}}));
+    size_t nevents(std::stoul(args["events"]));
+    size_t nnu(std::stoul(args["neutrinos"]));
+    size_t nfiles(std::max<size_t>(std::stoul(args["files"]), 1));
+    double selected(std::stod(args["selected"]));
+    size_t nsyst(std::stoul(args["systematics"]));
+    size_t nuniv(std::stoul(args["universes"]));
+    std::mt19937_64 rng(std::stoull(args["seed"]));
+    std::uniform_real_distribution<double> unit(0, 1);
+    bench::Harness harness(std::stod(args["min-time"]));
+
+    /**
+     * @brief Generate the synthetic selection.
+     * @details A fraction of the neutrinos of all events is selected. Each
+     * candidate has the same columns as the selection TTrees of the analysis
+     * ("nu_id" and a variable), stored as in @ref sys::trees::read_selection().
+     */
+    std::shared_ptr<sys::trees::selection_t> selection(std::make_shared<sys::trees::selection_t>());
+    selection->names = {"nu_id", "var"};
+    selection->inu = 0;
+    std::vector<sys::index::key_t> keys, misses;
+    for(uint32_t e(0); e < nevents; ++e)
+    {
+        for(size_t n(0); n < nnu; ++n)
+        {
+            sys::index::key_t key(sys::index::make_key(1, e / 100, e, n));
+            if(unit(rng) >= selected)
+            {
+                misses.push_back(key);
+                continue;
+            }
+            selection->candidates.insert(key, keys.size());
+            selection->events.insert(sys::index::make_event_key(1, e / 100, e), keys.size());
+            selection->rows.push_back(n);
+            selection->rows.push_back(unit(rng));
+            keys.push_back(key);
+        }
+    }
+
+    /**
+     * @brief Benchmark the candidate index.
+     */
+    harness.Run("index/insert", keys.size(), [&keys]()
+    {
+        sys::index::CandidateIndex index(keys.size());
+        for(size_t i(0); i < keys.size(); ++i)
+            index.insert(keys[i], i);
+        bench::keep(index.size());
+    });
+    harness.Run("index/find_hit", keys.size(), [&keys, &selection]()
+    {
+        size_t sum(0);
+        for(const sys::index::key_t & k : keys)
+            sum += selection->candidates.find(k);
+        bench::keep(sum);
+    });
+    harness.Run("index/find_miss", misses.size(), [&misses, &selection]()
+    {
+        size_t sum(0);
+        for(const sys::index::key_t & k : misses)
+            sum += selection->candidates.contains(k);
+        bench::keep(sum);
+    });
+
+    /**
+     * @brief Benchmark the universe histograms.
+     */
+    std::vector<double> edges;
+    for(size_t b(0); b <= 20; ++b)
+        edges.push_back(b * 0.05);
+    std::vector<float> weights(nuniv);
+    for(float & w : weights)
+        w = unit(rng);
+    harness.Run("histogram/fill/" + std::to_string(nuniv) + "_universes", keys.size(), [&]()
+    {
+        sys::hist::UniverseHistogram h(edges, nuniv);
+        for(size_t i(0); i < keys.size(); ++i)
+            h.Fill(selection->rows[2 * i + 1], weights.data());
+        bench::keep(h.GetContent(1, 0));
+    });
+
+    /**
+     * @brief Benchmark the matching with the synthetic CAF files.
+     * @details The files are written once to the working directory and read
+     * back by each iteration. The sink only counts the matches, so the
+     * benchmark measures the reading, the matching, and the copying of the
+     * universe weights.
+     */
+    std::ofstream caflist("bench_caflist.txt");
+    size_t per_file((nevents + nfiles - 1) / nfiles);
+    for(size_t f(0); f < nfiles; ++f)
+    {
+        std::string path("bench_caf_" + std::to_string(f) + ".root");
+        size_t first(f * per_file);
+        write_caf(path, first, std::min(per_file, nevents - std::min(nevents, first)), nnu, nsyst, nuniv, rng);
+        caflist << path << std::endl;
+    }
+    caflist.close();
+
+    sys::cfg::JobConfig job{"", "", "bench_caflist.txt", std::stoll(args["threads"])};
+    size_t nmatches(0);
+    sys::trees::weight_request_t request;
+    request.label = "bench";
+    request.selection = selection;
+    for(size_t s(0); s < nsyst; ++s)
+        request.systs["syst" + std::to_string(s)] = s;
+    request.sink = [&nmatches](sys::trees::match_t &) { ++nmatches; };
+    request.finish = []() {};
+    std::vector<sys::trees::weight_request_t> requests = {request};
+    harness.Run("match_weight_systematics/" + args["threads"] + "_threads", nevents, [&]()
+    {
+        nmatches = 0;
+        sys::trees::match_weight_systematics(job, requests);
+        bench::keep(nmatches);
+    });
+    if(nmatches != keys.size())
+        std::cerr << "Warning: Matched " << nmatches << " of " << keys.size() << " candidates." << std::endl;
+
+    harness.WriteJSON(args["output"], "systematics", {
+        {"events", double(nevents)}, {"neutrinos", double(nnu)}, {"files", double(nfiles)}, {"selected", selected},
+        {"systematics", double(nsyst)}, {"universes", double(nuniv)}, {"threads", std::stod(args["threads"])}});
+    return 0;
+}
@@ -10,6 +10,8 @@
  * @author mueller@fnal.gov
  */
 #include <string>
+#include <algorithm>
+#include <functional>
 
 #include "configuration.h"
 #include "toml++/toml.h"
@@ -53,6 +55,13 @@ namespace sys::cfg
         return *value;
     }
 
+    // Retrieve the requested string field from the configuration table, or
+    // the default value if the field is not present.
+    std::string ConfigurationTable::get_string_field(const std::string & field, const std::string & default_value)
+    {
+        return config.at_path(field).value<std::string>().value_or(default_value);
+    }
+
     // Retrieve the requested vector of strings from the configuration table.
     std::vector<std::string> ConfigurationTable::get_string_vector(const std::string & field)
     {
@@ -63,6 +72,23 @@ namespace sys::cfg
         return values;
     }
 
+    // Retrieve the requested vector of numbers from the configuration table.
+    std::vector<double> ConfigurationTable::get_double_vector(const std::string & field)
+    {
+        std::vector<double> values;
+        toml::array * elements = config[field].as_array();
+        if(!elements)
+            throw ConfigurationError("Field " + field + " (array) not found in the configuration file.");
+        for(auto & e : *elements)
+        {
+            std::optional<double> value(e.value<double>());
+            if(!value)
+                throw ConfigurationError("Field " + field + " contains a non-numeric element.");
+            values.push_back(*value);
+        }
+        return values;
+    }
+
     // Retrieve the requested integer field from the configuration table.
     int64_t ConfigurationTable::get_int_field(const std::string & field)
     {
@@ -72,12 +98,115 @@ namespace sys::cfg
         return *value;
     }
 
+    // Retrieve the requested integer field from the configuration table, or
+    // the default value if the field is not present.
+    int64_t ConfigurationTable::get_int_field(const std::string & field, int64_t default_value)
+    {
+        return config.at_path(field).value<int64_t>().value_or(default_value);
+    }
+
     // Validate the configuration file by checking that all the requisite
     // fields are present.
     void ConfigurationTable::validate()
     {
         check_field("input.path");
         check_field("output.path");
+        job = JobConfig{get_string_field("input.path"), get_string_field("output.path"),
+                        get_string_field("input.caflist", ""), get_int_field("input.nthreads", 1)};
+
+        trees.clear();
+        systematics.clear();
+        toml::array * elements = config["tree"].as_array();
+        if(!elements)
+            return;
+        for(auto & e : *elements)
+        {
+            if(!e.as_table())
+                throw ConfigurationError("Each [[tree]] entry must be a table.");
+            ConfigurationTable t(*e.as_table());
+            TreeConfig tree;
+            tree.action = t.get_string_field("action");
+            tree.origin = t.get_string_field("origin");
+            tree.destination = t.get_string_field("destination");
+            tree.name = t.get_string_field("name");
+            if(tree.action == "copy")
+            {
+                tree.mode = t.get_string_field("mode", "fast");
+                if(tree.mode != "fast" && tree.mode != "typed")
+                    throw ConfigurationError("Unknown copy mode " + tree.mode + " for tree " + tree.name + ".");
+                trees.push_back(tree);
+                continue;
+            }
+            if(tree.action != "add_weights" && tree.action != "histogram" && tree.action != "covariance")
+                throw ConfigurationError("Unknown action " + tree.action + " for tree " + tree.name + ".");
+
+            // All other actions use systematic tables, which must exist.
+            if(!t.config["table"].as_array())
+                throw ConfigurationError("Field table (array) of tree " + tree.name + " not found in the configuration file.");
+            tree.tables = t.get_string_vector("table");
+            for(const std::string & s : tree.tables)
+            {
+                if(systematics.find(s) != systematics.end())
+                    continue;
+                toml::array * systs = config[s].as_array();
+                if(!systs)
+                    throw ConfigurationError("Systematic table " + s + " referenced by tree " + tree.name + " not found in the configuration file.");
+                std::vector<SystematicConfig> & resolved(systematics[s]);
+                for(auto & st : *systs)
+                {
+                    if(!st.as_table())
+                        throw ConfigurationError("Each element of systematic table " + s + " must be a table.");
+                    ConfigurationTable sc(*st.as_table());
+                    resolved.push_back(SystematicConfig{sc.get_string_field("name"), sc.get_int_field("index")});
+                }
+            }
+
+            // Actions that read the CAF files require the file list.
+            if((tree.action == "add_weights" || tree.action == "covariance") && job.caflist.empty())
+                throw ConfigurationError("Field input.caflist (string) required by tree " + tree.name + " not found in the configuration file.");
+
+            if(tree.action == "add_weights")
+            {
+                tree.format = t.get_string_field("format", "vector");
+                if(tree.format != "vector" && tree.format != "flat")
+                    throw ConfigurationError("Unknown weight format " + tree.format + " for tree " + tree.name + ".");
+            }
+            else
+            {
+                tree.variable = t.get_string_field("variable");
+                tree.bins = t.get_double_vector("bins");
+                if(tree.bins.size() < 2 || std::adjacent_find(tree.bins.begin(), tree.bins.end(), std::greater_equal<>()) != tree.bins.end())
+                    throw ConfigurationError("Field bins of tree " + tree.name + " must be at least two strictly increasing bin edges.");
+
+                // The covariance of the parameters of the multisigma tables uses their +/-1 sigma universes.
+                if(tree.action == "covariance" && t.config["sigma_tables"])
+                {
+                    if(!t.config["sigma_tables"].as_array())
+                        throw ConfigurationError("Field sigma_tables of tree " + tree.name + " must be an array of table names.");
+                    tree.sigma_tables = t.get_string_vector("sigma_tables");
+                    for(const std::string & s : tree.sigma_tables)
+                    {
+                        if(std::find(tree.tables.begin(), tree.tables.end(), s) == tree.tables.end())
+                            throw ConfigurationError("Table " + s + " in field sigma_tables of tree " + tree.name + " is not listed in its field table.");
+                    }
+                    if(!t.config["sigmas"].as_array())
+                        throw ConfigurationError("Field sigmas (array) required by the field sigma_tables of tree " + tree.name + " not found in the configuration file.");
+                    tree.sigmas = t.get_double_vector("sigmas");
+                    if(std::find(tree.sigmas.begin(), tree.sigmas.end(), 1.0) == tree.sigmas.end() || std::find(tree.sigmas.begin(), tree.sigmas.end(), -1.0) == tree.sigmas.end())
+                        throw ConfigurationError("Field sigmas of tree " + tree.name + " must contain the +1 and -1 sigma universes.");
+                }
+            }
+            trees.push_back(tree);
+        }
+    }
+
+    // Retrieve the resolved systematic parameters of a systematic table.
+    const std::vector<SystematicConfig> & ConfigurationTable::get_systematics(const std::string & table) const
+    {
+        std::map<std::string, std::vector<SystematicConfig>>::const_iterator it(systematics.find(table));
+        if(it == systematics.end())
+            throw ConfigurationError("Systematic table " + table + " not found in the configuration file.");
+        return it->second;
     }
 
     // Get a list of all subtables matching the requested table name.
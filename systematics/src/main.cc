@@ -76,28 +76,51 @@ int main(int argc, char * argv[])
      * analysis framework. The output ROOT file is the file that will contain
      * the TTrees that are produced by this code.
      */
-    TFile * input = TFile::Open(config.get_string_field("input.path").c_str(), "READ");
-    TFile * output = TFile::Open(config.get_string_field("output.path").c_str(), "RECREATE");
+    TFile * input = TFile::Open(config.get_job().input_path.c_str(), "READ");
+    TFile * output = TFile::Open(config.get_job().output_path.c_str(), "RECREATE");
 
     /**
      * @brief Begin main loop over trees in the configuration file.
      * @details This block begins the main loop over the trees in the
      * configuration file. Each tree is a sub-table in the configuration file,
-     * and can be fetched as a vector of sub-tables using the function
-     * @ref sys::cfg::get_subtables(). The main body of the loop then reads
-     * delegates the handling of the tree to the appropriate function.
-     * @see sys::cfg::get_subtables()
-     * @see sys::cfg::ConfigurationTable
+     * which is resolved (and validated) into a @ref sys::cfg::TreeConfig when
+     * the configuration file is loaded. The work is split into two phases:
+     * the planning phase handles the "copy" trees directly and collects a
+     * @ref sys::trees::weight_request_t for every tree that consumes universe
+     * weights ("add_weights" and "covariance"), which are then all served by
+     * a single pass over the input CAF files. The "histogram" action reads
+     * from the output file, so it is run after the pass and may histogram the
+     * trees written by the "add_weights" actions of the same job.
+     * @see sys::cfg::ConfigurationTable::get_trees()
+     * @see sys::trees::match_weight_systematics()
      */
-    std::vector<sys::cfg::ConfigurationTable> tables = config.get_subtables("tree");
-    for(sys::cfg::ConfigurationTable & table : tables)
+    try
+    {
+        std::vector<sys::trees::weight_request_t> requests;
+        for(const sys::cfg::TreeConfig & tree : config.get_trees())
+        {
+            if(tree.action == "copy")
+                sys::trees::copy_tree(tree, output, input);
+            else if(tree.action == "add_weights")
+                sys::trees::plan_weight_systematics(config, tree, output, input, requests);
+            else if(tree.action == "covariance")
+                sys::trees::plan_covariance(config, tree, output, input, requests);
+        }
+        sys::trees::match_weight_systematics(config.get_job(), requests);
+        for(const sys::cfg::TreeConfig & tree : config.get_trees())
+        {
+            if(tree.action == "histogram")
+                sys::trees::fill_universe_histograms(tree, output, output);
+        }
+    }
+    catch(const sys::cfg::ConfigurationError & e)
     {
-        std::string type(table.get_string_field("action"));
-        if(type == "copy")
-            sys::trees::copy_tree(table, output, input);
-        else if(type == "add_weights")
-            sys::trees::copy_with_weight_systematics(config, table, output, input);
+        std::cerr << "Error: " << e.what() << std::endl;
+        input->Close();
+        output->Close();
+        return 1;
     }
+    input->Close();
     output->Close();
 
     return 0;
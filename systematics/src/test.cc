@@ -0,0 +1,146 @@
+/**
+ * @file test.cc
+ * @brief Tests of the reading of the selection TTrees written by the
+ * Analysis class.
+ * @details This executable writes in-memory selection TTrees with the branch
+ * layout of the TTrees written by the cafana Analysis class (see
+ * cafana/include/storage.h), including the streamed TTrees and the TTrees
+ * with storage types, and reads them back through
+ * @ref sys::trees::read_selection(). Each failed check is
+ * printed, and the exit code is the number of failed checks.
+ * Usage: test_systematics
+ * @author mueller@fnal.gov
+ */
+#include <iostream>
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+#include "trees.h"
+#include "index.h"
+
+#include "TROOT.h"
+#include "TMemFile.h"
+#include "TTree.h"
+
+#include "include/storage.h"
+
+/**
+ * @brief The number of failed checks.
+ */
+static int failures(0);
+
+/**
+ * @brief Check a condition and report it if it fails.
+ * @param condition The condition to check.
+ * @param message The description of the check.
+ * @return void
+ */
+void check(bool condition, const std::string & message)
+{
+    if(!condition)
+    {
+        std::cerr << "FAILED: " << message << std::endl;
+        ++failures;
+    }
+}
+
+/**
+ * @brief Write a selection TTree with the layout of the streamed TTrees.
+ * @details The TTree has the given columns, followed by the (Int_t) Run,
+ * Subrun, and Evt branches, and one entry per candidate. The "nu_id" column
+ * holds the nu_id of the candidate, and any other column half its Evt.
+ * @param file The file to create the TTree in.
+ * @param name The name of the TTree.
+ * @param columns The names of the columns.
+ * @param types The storage types of the columns.
+ * @param candidates The (run, subrun, evt, nu_id) of each candidate.
+ * @return The TTree.
+ */
+TTree * write_selection(TMemFile & file, const std::string & name, const std::vector<std::string> & columns, const std::vector<ana::ColumnType> & types, const std::vector<std::array<int, 4>> & candidates)
+{
+    file.cd();
+    TTree * tree = new TTree(name.c_str(), name.c_str());
+    std::vector<uint64_t> values(columns.size(), 0);
+    Int_t ids[3] = {0, 0, 0};
+    ana::book_typed_branches(tree, columns, types, values, ids);
+    for(const std::array<int, 4> & c : candidates)
+    {
+        for(size_t k(0); k < 3; ++k)
+            ids[k] = c[k];
+        for(size_t i(0); i < columns.size(); ++i)
+            ana::store_value(types[i], &values[i], columns[i] == "nu_id" ? c[3] : 0.5 * c[2], columns[i]);
+        tree->Fill();
+    }
+    return tree;
+}
+
+int main()
+{
+    TMemFile file("test_systematics.root", "RECREATE");
+    const std::vector<std::array<int, 4>> candidates = {{1, 2, 10, 0}, {1, 2, 10, 1}, {1, 3, 42, 0}};
+
+    /**
+     * @brief Read a streamed selection TTree, with double columns and with
+     * storage types (the variable as a float and nu_id as an int).
+     */
+    typedef std::vector<ana::ColumnType> types_t;
+    for(const types_t & types : {types_t{ana::ColumnType::Double, ana::ColumnType::Double}, types_t{ana::ColumnType::Int32, ana::ColumnType::Float}})
+    {
+        std::string label(types[1] == ana::ColumnType::Double ? "double" : "typed");
+        TTree * tree = write_selection(file, "selectedNu_" + label, {"nu_id", "var"}, types, candidates);
+        sys::trees::selection_t selection;
+        check(sys::trees::read_selection(tree, selection), label + " TTree is read");
+        check(selection.names == std::vector<std::string>({"nu_id", "var"}), label + " columns precede the identifiers");
+        check(selection.inu == 0, label + " nu_id is located among the columns");
+        check(selection.rows.size() == 2 * candidates.size(), label + " one row per entry");
+        for(size_t i(0); i < candidates.size() && selection.rows.size() == 2 * candidates.size(); ++i)
+        {
+            const std::array<int, 4> & c(candidates[i]);
+            std::string entry(label + " entry " + std::to_string(i));
+            check(selection.rows[2 * i] == c[3], "nu_id of " + entry);
+            check(selection.rows[2 * i + 1] == 0.5 * c[2], "var of " + entry);
+            check(selection.candidates.find(sys::index::make_key(c[0], c[1], c[2], c[3])) == i, "key of " + entry);
+            check(selection.events.contains(sys::index::make_event_key(c[0], c[1], c[2])), "event of " + entry);
+        }
+        check(!selection.candidates.contains(sys::index::make_key(1, 2, 11, 0)), label + " unknown key is missing");
+        delete tree;
+    }
+
+    /**
+     * @brief Reject a selection TTree without "nu_id".
+     */
+    {
+        TTree * tree = write_selection(file, "noNu", {"var"}, {ana::ColumnType::Double}, candidates);
+        sys::trees::selection_t selection;
+        check(!sys::trees::read_selection(tree, selection), "TTree without nu_id is rejected");
+        delete tree;
+    }
+
+    /**
+     * @brief Reject the values a storage type cannot represent.
+     */
+    {
+        check(!ana::representable(ana::ColumnType::Bool, -1), "unmatched value is not a bool");
+        check(!ana::representable(ana::ColumnType::Int8, 128), "out-of-range value is not an int8");
+        check(ana::representable(ana::ColumnType::Int8, -1), "unmatched value is an int8");
+        uint64_t value(0);
+        bool rejected(false);
+        try
+        {
+            ana::store_value(ana::ColumnType::Bool, &value, -1, "cc");
+        }
+        catch(const std::runtime_error &)
+        {
+            rejected = true;
+        }
+        check(rejected, "storing an unmatched bool is rejected");
+    }
+
+    file.Close();
+    if(failures == 0)
+        std::cout << "All checks passed." << std::endl;
+    return failures;
+}